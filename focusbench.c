@@ -0,0 +1,647 @@
+// focusbench.c - end-to-end fairness and overhead evaluation of focusd
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // sched_setaffinity, CPU_SET
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+
+#include "libfocus.h"
+
+#define MAX_WORKERS 64
+#define MAX_TIMESLICES 16
+#define MAX_FOCUSD_ARGS 16
+
+/*
+ * focusbench starts synthetic workers pinned to one CPU so that they
+ * contend, registers them through focusctl with assorted ticket counts
+ * and runs focusd at each requested timeslice.  While focusd runs, the
+ * utime+stime of every worker and of focusd itself is sampled from
+ * /proc/<pid>/stat, and the achieved CPU share is compared with the
+ * share the tickets ask for.
+ *
+ * I/O workers sleep in fdatasync most of the time and cannot use their
+ * ticket share.  Their demand is measured once with the CPU workers
+ * stopped, and targets are then water-filled: a worker that needs less
+ * than its ticket share of what is left is targeted at its demand, and
+ * the rest is split by tickets among the others.
+ */
+
+struct worker
+{
+    pid_t pid;
+    int tickets;
+    int io;
+    int stat_fd;
+    double demand; // io workers: share of the CPU used when running alone
+    double target;
+    unsigned long long start;
+    unsigned long long prev;
+    // sums over sliding windows of (share - target) and its square
+    double err_sum;
+    double err_sq;
+};
+
+struct bench_opts
+{
+    int nworkers;
+    int nio;
+    int cpu;
+    int duration_s;
+    int sample_ms;
+    int window_ms;
+    int ntimeslices;
+    int timeslices[MAX_TIMESLICES];
+    const char *focusctl;
+    const char *focusd;
+    int nfocusd_args;
+    char *focusd_args[MAX_FOCUSD_ARGS];
+};
+
+static struct worker workers[MAX_WORKERS];
+static int nworkers_started = 0;
+static volatile sig_atomic_t interrupted = 0;
+
+static void handle_int(int sig)
+{
+    (void)sig;
+    interrupted = 1;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void sleep_ms(int ms)
+{
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+}
+
+// Returns utime+stime in clock ticks from an open /proc/<pid>/stat fd.
+static int read_cpu_ticks(int fd, unsigned long long *out)
+{
+    char buf[1024];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0)
+        return -1;
+    buf[n] = '\0';
+
+    char *p = strrchr(buf, ')');
+    if (!p)
+        return -1;
+    // p + 2 is field 3; utime and stime are fields 14 and 15
+    p += 2;
+    for (int field = 3; field < 14; field++)
+    {
+        p = strchr(p, ' ');
+        if (!p)
+            return -1;
+        p++;
+    }
+    char *end;
+    unsigned long long utime = strtoull(p, &end, 10);
+    unsigned long long stime = strtoull(end, NULL, 10);
+    *out = utime + stime;
+    return 0;
+}
+
+static int open_stat(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static void pin_to_cpu(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0)
+        perror("sched_setaffinity");
+}
+
+static void cpu_worker(void)
+{
+    volatile unsigned long x = 0;
+    for (;;)
+        x++;
+}
+
+// Short compute bursts between synchronous writes, so it mostly sleeps.
+static void io_worker(void)
+{
+    char path[] = "/tmp/focusbench.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+        _exit(1);
+    unlink(path);
+
+    static char buf[64 * 1024];
+    memset(buf, 'x', sizeof(buf));
+    for (;;)
+    {
+        volatile unsigned long x = 0;
+        for (int i = 0; i < 1000000; i++)
+            x++;
+        if (pwrite(fd, buf, sizeof(buf), 0) < 0 || fdatasync(fd) < 0)
+            _exit(1);
+    }
+}
+
+static pid_t spawn_worker(int cpu, int io)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        pin_to_cpu(cpu);
+        if (io)
+            io_worker();
+        cpu_worker();
+    }
+    return pid;
+}
+
+static int run_quiet(char *const argv[])
+{
+    pid_t pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid == 0)
+    {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0)
+            dup2(devnull, STDOUT_FILENO);
+        execvp(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0)
+        return -1;
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : -1;
+}
+
+static int focusctl_tickets(const struct bench_opts *o, pid_t pid, int tickets)
+{
+    char pid_s[32], tickets_s[32];
+    snprintf(pid_s, sizeof(pid_s), "%d", pid);
+    snprintf(tickets_s, sizeof(tickets_s), "%d", tickets);
+
+    char *add[] = {(char *)o->focusctl, (char *)"add", pid_s, tickets_s, NULL};
+    char *rm[] = {(char *)o->focusctl, (char *)"remove", pid_s, NULL};
+    return run_quiet(tickets > 0 ? add : rm);
+}
+
+static pid_t start_focusd(const struct bench_opts *o, int timeslice_ms)
+{
+    char ts[32];
+    snprintf(ts, sizeof(ts), "%d", timeslice_ms);
+
+    char *argv[MAX_FOCUSD_ARGS + 3];
+    int n = 0;
+    argv[n++] = (char *)o->focusd;
+    argv[n++] = ts;
+    for (int i = 0; i < o->nfocusd_args; i++)
+        argv[n++] = o->focusd_args[i];
+    argv[n] = NULL;
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0)
+            dup2(devnull, STDOUT_FILENO);
+        execvp(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    return pid;
+}
+
+static void stop_child(pid_t pid)
+{
+    if (pid <= 0)
+        return;
+    kill(pid, SIGTERM);
+    for (int i = 0; i < 50; i++)
+    {
+        if (waitpid(pid, NULL, WNOHANG) == pid)
+            return;
+        sleep_ms(20);
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+}
+
+static void cleanup(const struct bench_opts *o)
+{
+    for (int i = 0; i < nworkers_started; i++)
+    {
+        focusctl_tickets(o, workers[i].pid, 0);
+        kill(workers[i].pid, SIGKILL);
+        waitpid(workers[i].pid, NULL, 0);
+        if (workers[i].stat_fd >= 0)
+            close(workers[i].stat_fd);
+    }
+    nworkers_started = 0;
+}
+
+#define CALIBRATE_MS 2000
+
+// Measures what the io workers use of the CPU with nothing to compete with.
+static void calibrate_io(void)
+{
+    int n = nworkers_started;
+    unsigned long long begin[MAX_WORKERS];
+    int nio = 0;
+
+    for (int i = 0; i < n; i++)
+        nio += workers[i].io;
+    if (nio == 0)
+        return;
+    for (int i = 0; i < n; i++)
+    {
+        if (!workers[i].io)
+            kill(workers[i].pid, SIGSTOP);
+    }
+    sleep_ms(200); // past the mkstemp and first writes
+    for (int i = 0; i < n; i++)
+        read_cpu_ticks(workers[i].stat_fd, &begin[i]);
+    double t0 = now_sec();
+    sleep_ms(CALIBRATE_MS);
+    double elapsed = now_sec() - t0;
+
+    long hz = sysconf(_SC_CLK_TCK);
+    for (int i = 0; i < n; i++)
+    {
+        unsigned long long end = begin[i];
+        if (!workers[i].io)
+        {
+            kill(workers[i].pid, SIGCONT);
+            continue;
+        }
+        read_cpu_ticks(workers[i].stat_fd, &end);
+        workers[i].demand = (double)(end - begin[i]) / hz / elapsed;
+        printf("focusbench: io worker %d uses %.1f%% of the CPU alone\n", workers[i].pid,
+               100.0 * workers[i].demand);
+    }
+}
+
+// Water-fills the CPU: bounded io demand first, tickets split the rest.
+static void compute_targets(void)
+{
+    int n = nworkers_started;
+    int fixed[MAX_WORKERS] = {0};
+    double left = 1.0;
+    int changed = 1;
+
+    while (changed)
+    {
+        changed = 0;
+        long tickets = 0;
+        for (int i = 0; i < n; i++)
+        {
+            if (!fixed[i])
+                tickets += workers[i].tickets;
+        }
+        for (int i = 0; i < n && tickets > 0; i++)
+        {
+            if (fixed[i] || !workers[i].io)
+                continue;
+            double fair = left * workers[i].tickets / tickets;
+            if (workers[i].demand < fair)
+            {
+                workers[i].target = workers[i].demand;
+                left -= workers[i].demand;
+                fixed[i] = 1;
+                changed = 1;
+                break; // the fair shares of the others grew
+            }
+        }
+        if (!changed)
+        {
+            for (int i = 0; i < n; i++)
+            {
+                if (!fixed[i])
+                    workers[i].target = left * workers[i].tickets / tickets;
+            }
+        }
+    }
+
+    // with only io workers the CPU idles, and shares are of what they used
+    double sum = 0.0;
+    for (int i = 0; i < n; i++)
+        sum += workers[i].target;
+    for (int i = 0; i < n && sum > 0.0; i++)
+        workers[i].target /= sum;
+}
+
+// Runs focusd at one timeslice and prints achieved vs. target shares.
+static int run_timeslice(const struct bench_opts *o, int timeslice_ms, double *out_abs_err)
+{
+    int n = nworkers_started;
+
+    // ring of the last span+1 samples per worker for the sliding window
+    int span = o->window_ms / o->sample_ms;
+    unsigned long long *hist = (unsigned long long *)calloc((size_t)n * (span + 1), sizeof(*hist));
+    if (!hist)
+    {
+        perror("calloc");
+        return -1;
+    }
+
+    pid_t focusd = start_focusd(o, timeslice_ms);
+    if (focusd < 0)
+    {
+        free(hist);
+        return -1;
+    }
+    int focusd_fd = open_stat(focusd);
+
+    // warm-up: let focusd start and place everyone once
+    sleep_ms(1000);
+
+    unsigned long long focusd_start = 0, focusd_end = 0;
+    if (focusd_fd >= 0)
+        read_cpu_ticks(focusd_fd, &focusd_start);
+    for (int i = 0; i < n; i++)
+    {
+        read_cpu_ticks(workers[i].stat_fd, &workers[i].start);
+        workers[i].prev = workers[i].start;
+        workers[i].err_sum = 0.0;
+        workers[i].err_sq = 0.0;
+        hist[(size_t)i * (span + 1)] = workers[i].start;
+    }
+
+    double t0 = now_sec();
+    int nsamples = 0;
+    int nwindows = 0;
+
+    // the window ending at every sample, not just every span-th one
+    while (!interrupted && now_sec() - t0 < o->duration_s)
+    {
+        sleep_ms(o->sample_ms);
+        nsamples++;
+        for (int i = 0; i < n; i++)
+        {
+            read_cpu_ticks(workers[i].stat_fd, &workers[i].prev);
+            hist[(size_t)i * (span + 1) + nsamples % (span + 1)] = workers[i].prev;
+        }
+        if (nsamples < span)
+            continue;
+
+        int first = (nsamples - span) % (span + 1);
+        unsigned long long window_total = 0;
+        for (int i = 0; i < n; i++)
+            window_total += workers[i].prev - hist[(size_t)i * (span + 1) + first];
+        if (window_total == 0)
+            continue;
+        for (int i = 0; i < n; i++)
+        {
+            unsigned long long used = workers[i].prev - hist[(size_t)i * (span + 1) + first];
+            double err = (double)used / window_total - workers[i].target;
+            workers[i].err_sum += err;
+            workers[i].err_sq += err * err;
+        }
+        nwindows++;
+    }
+    free(hist);
+
+    double elapsed = now_sec() - t0;
+    if (focusd_fd >= 0)
+    {
+        read_cpu_ticks(focusd_fd, &focusd_end);
+        close(focusd_fd);
+    }
+    int alive = (waitpid(focusd, NULL, WNOHANG) == 0);
+    stop_child(focusd);
+    if (!alive)
+    {
+        fprintf(stderr, "focusd exited early at timeslice %d ms\n", timeslice_ms);
+        return -1;
+    }
+
+    unsigned long long total = 0;
+    for (int i = 0; i < n; i++)
+        total += workers[i].prev - workers[i].start;
+
+    long hz = sysconf(_SC_CLK_TCK);
+    double focusd_pct = 100.0 * (double)(focusd_end - focusd_start) / hz / elapsed;
+
+    printf("\ntimeslice %d ms: %.1f s, %d sliding windows of %d ms, focusd CPU %.2f%%\n",
+           timeslice_ms, elapsed, nwindows, o->window_ms, focusd_pct);
+    printf("  %-8s %-4s %8s %8s %9s %8s %12s\n", "PID", "Kind", "Tickets", "Target%",
+           "Achieved%", "Error", "WindowStdev");
+
+    double abs_err = 0.0;
+    for (int i = 0; i < n; i++)
+    {
+        double target = workers[i].target;
+        double achieved = total ? (double)(workers[i].prev - workers[i].start) / total : 0.0;
+        double stdev = 0.0;
+        if (nwindows > 1)
+        {
+            double mean = workers[i].err_sum / nwindows;
+            double var = workers[i].err_sq / nwindows - mean * mean;
+            stdev = var > 0.0 ? sqrt(var) : 0.0;
+        }
+        abs_err += fabs(achieved - target);
+        printf("  %-8d %-4s %8d %7.1f%% %8.1f%% %+7.1fpp %10.1fpp\n", workers[i].pid,
+               workers[i].io ? "io" : "cpu", workers[i].tickets, 100.0 * target,
+               100.0 * achieved, 100.0 * (achieved - target), 100.0 * stdev);
+    }
+    *out_abs_err = abs_err / n;
+    printf("  mean |error| %.2fpp\n", 100.0 * *out_abs_err);
+    fflush(stdout);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-n cpu_workers] [-i io_workers] [-t ms,ms,...] [-d seconds]\n"
+            "          [-s sample_ms] [-w window_ms] [-c cpu] [--focusctl PATH]\n"
+            "          [--focusd PATH] [-- focusd options...]\n"
+            "Example: sudo %s -n 4 -t 20,50,100,200 -d 20 -- --backend nice\n",
+            prog, prog);
+}
+
+static int parse_timeslices(struct bench_opts *o, const char *list)
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", list);
+    o->ntimeslices = 0;
+    for (char *tok = strtok(buf, ","); tok; tok = strtok(NULL, ","))
+    {
+        int ms = atoi(tok);
+        if (ms <= 0 || o->ntimeslices >= MAX_TIMESLICES)
+            return -1;
+        o->timeslices[o->ntimeslices++] = ms;
+    }
+    return o->ntimeslices > 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_opts o;
+    memset(&o, 0, sizeof(o));
+    o.nworkers = 4;
+    o.duration_s = 20;
+    o.sample_ms = 100;
+    o.window_ms = 1000;
+    o.cpu = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    o.focusctl = "focusctl";
+    o.focusd = "focusd";
+    parse_timeslices(&o, "20,50,100,200");
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *a = argv[i];
+        const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(a, "--") == 0)
+        {
+            for (i++; i < argc && o.nfocusd_args < MAX_FOCUSD_ARGS; i++)
+                o.focusd_args[o.nfocusd_args++] = argv[i];
+            break;
+        }
+        if (!v)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        if (strcmp(a, "-n") == 0)
+            o.nworkers = atoi(v);
+        else if (strcmp(a, "-i") == 0)
+            o.nio = atoi(v);
+        else if (strcmp(a, "-d") == 0)
+            o.duration_s = atoi(v);
+        else if (strcmp(a, "-s") == 0)
+            o.sample_ms = atoi(v);
+        else if (strcmp(a, "-w") == 0)
+            o.window_ms = atoi(v);
+        else if (strcmp(a, "-c") == 0)
+            o.cpu = atoi(v);
+        else if (strcmp(a, "--focusctl") == 0)
+            o.focusctl = v;
+        else if (strcmp(a, "--focusd") == 0)
+            o.focusd = v;
+        else if (strcmp(a, "-t") == 0)
+        {
+            if (parse_timeslices(&o, v) < 0)
+            {
+                fprintf(stderr, "Invalid timeslice list: %s\n", v);
+                return 1;
+            }
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    if (o.nworkers < 0 || o.nio < 0 || o.nworkers + o.nio < 2 ||
+        o.nworkers + o.nio > MAX_WORKERS || o.duration_s <= 0 || o.sample_ms <= 0 ||
+        o.window_ms < o.sample_ms || o.cpu < 0)
+    {
+        fprintf(stderr, "Need 2..%d workers, positive durations and window >= sample.\n",
+                MAX_WORKERS);
+        return 1;
+    }
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    if (o.cpu >= ncpu)
+    {
+        // sched_setaffinity would fail and leave the workers unpinned
+        fprintf(stderr, "CPU %d is not online (%ld CPUs).\n", o.cpu, ncpu);
+        return 1;
+    }
+
+    if (focus_check_cgroup_v2() < 0)
+        return 1;
+
+    // other registered processes would take part in the lottery too
+    struct ticket_entry *existing = NULL;
+    int nexisting = 0;
+    if (focus_load_tickets(&existing, &nexisting) < 0)
+        return 1;
+    free(existing);
+    if (nexisting > 0)
+    {
+        fprintf(stderr, "%s already has %d entries; remove them before benchmarking.\n",
+                PROCS_FILE, nexisting);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_int;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int total = o.nworkers + o.nio;
+    for (int i = 0; i < total; i++)
+    {
+        struct worker *w = &workers[i];
+        w->io = (i >= o.nworkers);
+        w->tickets = 100 * (i % 4 + 1); // 1:2:3:4 pattern
+        w->pid = spawn_worker(o.cpu, w->io);
+        if (w->pid < 0)
+        {
+            perror("fork");
+            cleanup(&o);
+            return 1;
+        }
+        w->stat_fd = open_stat(w->pid);
+        nworkers_started++;
+        if (w->stat_fd < 0 || focusctl_tickets(&o, w->pid, w->tickets) < 0)
+        {
+            fprintf(stderr, "Failed to register worker %d with %s\n", w->pid, o.focusctl);
+            cleanup(&o);
+            return 1;
+        }
+    }
+
+    printf("focusbench: %d cpu + %d io workers pinned to CPU %d, %d s per timeslice\n",
+           o.nworkers, o.nio, o.cpu, o.duration_s);
+    calibrate_io();
+    compute_targets();
+
+    double abs_err[MAX_TIMESLICES];
+    int rc = 0;
+    for (int t = 0; t < o.ntimeslices && !interrupted; t++)
+    {
+        if (run_timeslice(&o, o.timeslices[t], &abs_err[t]) < 0)
+        {
+            rc = 1;
+            break;
+        }
+    }
+
+    if (rc == 0 && !interrupted)
+    {
+        printf("\nsummary:\n");
+        for (int t = 0; t < o.ntimeslices; t++)
+            printf("  timeslice %5d ms  mean |error| %.2fpp\n", o.timeslices[t], 100.0 * abs_err[t]);
+    }
+
+    cleanup(&o);
+    return interrupted ? 130 : rc;
+}
@@ -8,181 +8,204 @@
 #include <errno.h>
 #include <dirent.h>
 #include <ctype.h>
+#include <fcntl.h>
 #include <signal.h> // kill, SIGTERM, SIGKILL
+#include <sys/ioctl.h> // TIOCGWINSZ
+#include <time.h>
 
-#define CGROUP_ROOT "/sys/fs/cgroup"
-#define FOCUS_NAME "focus"
-#define BG_NAME "background"
+#include "libfocus.h"
 
-#define STATE_DIR "/var/lib/focusctl"
-#define PROCS_FILE STATE_DIR "/procs.txt"
+#define CAP_DEFAULT_PERIOD_US 100000
 
-struct ticket_entry
+static void print_profile(const struct focus_profile *p)
 {
-    pid_t pid;
-    int tickets;
-};
+    for (int i = 0; i < p->count; i++)
+    {
+        printf("  %-12s %-12s %s\n", p->knobs[i].group, p->knobs[i].knob, p->knobs[i].value);
+    }
+}
 
-static int write_file(const char *path, const char *value)
+static int init_cgroups(void)
 {
-    FILE *f = fopen(path, "w");
-    if (!f)
-    {
-        perror(path);
+    struct focus_profile profile;
+    if (focus_init_cgroups(&profile) < 0)
         return -1;
-    }
-    if (fprintf(f, "%s\n", value) < 0)
+
+    printf("Initialized focus and background cgroups:\n");
+    print_profile(&profile);
+    return 0;
+}
+
+static int move_pid(const char *group, pid_t pid)
+{
+    if (focus_move_pid(group, pid) < 0)
     {
-        perror("fprintf");
-        fclose(f);
+        fprintf(stderr, "Failed to move pid %d to %s\n", pid, group);
         return -1;
     }
-    if (fclose(f) != 0)
+
+    printf("Moved pid %d to %s group.\n", pid, group);
+    return 0;
+}
+
+static int move_pid_root(pid_t pid)
+{
+    if (focus_move_pid(NULL, pid) < 0)
     {
-        perror("fclose");
+        fprintf(stderr, "Failed to move pid %d to root cgroup\n", pid);
         return -1;
     }
+
+    printf("Moved pid %d back to root cgroup (unfocused).\n", pid);
     return 0;
 }
 
-static int ensure_dir(const char *path)
+static int is_number_str(const char *s)
 {
-    if (mkdir(path, 0755) < 0)
+    if (!s || !*s)
+        return 0;
+    for (const char *p = s; *p; p++)
     {
-        if (errno == EEXIST)
+        if (!isdigit((unsigned char)*p))
             return 0;
-        perror(path);
-        return -1;
     }
+    return 1;
+}
+
+static int reset_weights(void)
+{
+    static const char *const groups[] = {FOCUS_NAME, BG_NAME};
+    char path[256];
+
+    for (int g = 0; g < 2; g++)
+    {
+        snprintf(path, sizeof(path), "%s/%s/cpu.weight", CGROUP_ROOT, groups[g]);
+        if (focus_write_file(path, "100") < 0)
+            return -1;
+        snprintf(path, sizeof(path), "%s/%s/cpu.max", CGROUP_ROOT, groups[g]);
+        if (focus_write_file(path, "max") < 0)
+            return -1;
+
+        // cpu.max.burst needs Linux 5.14; io and memory need their controllers
+        snprintf(path, sizeof(path), "%s/%s/cpu.max.burst", CGROUP_ROOT, groups[g]);
+        if (access(path, F_OK) == 0)
+            focus_write_file(path, "0");
+        snprintf(path, sizeof(path), "%s/%s/io.weight", CGROUP_ROOT, groups[g]);
+        if (access(path, F_OK) == 0)
+            focus_write_file(path, "100");
+        snprintf(path, sizeof(path), "%s/%s/memory.low", CGROUP_ROOT, groups[g]);
+        if (access(path, F_OK) == 0)
+            focus_write_file(path, "0");
+        snprintf(path, sizeof(path), "%s/%s/memory.high", CGROUP_ROOT, groups[g]);
+        if (access(path, F_OK) == 0)
+            focus_write_file(path, "max");
+    }
+
+    printf("Reset cpu.weight and io.weight of focus and background to 100, CPU and memory limits cleared.\n");
+    printf("The stored profile is unchanged; init or a focusd profile reload applies it again.\n");
     return 0;
 }
 
-static int check_cgroup_v2(void)
+static int apply_saved_profile(const struct focus_profile *profile)
 {
     char path[256];
-    snprintf(path, sizeof(path), "%s/cgroup.controllers", CGROUP_ROOT);
+    snprintf(path, sizeof(path), "%s/%s", CGROUP_ROOT, BG_NAME);
     if (access(path, F_OK) != 0)
     {
-        fprintf(stderr, "cgroup v2 not found at %s\n", CGROUP_ROOT);
-        return -1;
+        printf("Profile saved; run init to create the cgroups.\n");
+        return 0;
     }
+    if (focus_apply_profiles(profile) < 0)
+        return -1;
+
+    printf("Applied resource profiles:\n");
+    print_profile(profile);
     return 0;
 }
 
-static int init_cgroups(void)
+static int profile_cmd(int argc, char **argv)
 {
-    char path[256];
+    struct focus_profile profile;
+    if (focus_load_profiles(&profile) < 0)
+        return -1;
 
-    if (check_cgroup_v2() < 0)
+    if (argc == 0)
     {
-        return -1;
+        printf("Resource profiles (%s):\n", PROFILES_FILE);
+        print_profile(&profile);
+        return 0;
     }
 
-    snprintf(path, sizeof(path), "%s/cgroup.subtree_control", CGROUP_ROOT);
-    FILE *sc = fopen(path, "r+");
-    if (sc)
+    if (argc == 1 && strcmp(argv[0], "reset") == 0)
     {
-        char buf[256] = {0};
-        if (fgets(buf, sizeof(buf), sc))
+        if (unlink(PROFILES_FILE) < 0 && errno != ENOENT)
         {
-            if (strstr(buf, "cpu") == NULL)
-            {
-                fclose(sc);
-                sc = fopen(path, "w");
-                if (sc)
-                {
-                    if (fprintf(sc, "+cpu\n") < 0)
-                    {
-                        perror("write subtree_control");
-                    }
-                    fclose(sc);
-                }
-            }
-            else
-            {
-                fclose(sc);
-            }
+            perror(PROFILES_FILE);
+            return -1;
         }
-        else
+        focus_profile_defaults(&profile);
+    }
+    else if (argc >= 3)
+    {
+        char value[128] = {0};
+        for (int i = 2; i < argc; i++)
         {
-            fclose(sc);
+            if (i > 2)
+                strncat(value, " ", sizeof(value) - strlen(value) - 1);
+            strncat(value, argv[i], sizeof(value) - strlen(value) - 1);
         }
+        if (focus_profile_set(&profile, argv[0], argv[1], value) < 0)
+            return -1;
+        if (focus_save_profiles(&profile) < 0)
+            return -1;
     }
-
-    snprintf(path, sizeof(path), "%s/%s", CGROUP_ROOT, FOCUS_NAME);
-    if (ensure_dir(path) < 0)
-        return -1;
-
-    snprintf(path, sizeof(path), "%s/%s", CGROUP_ROOT, BG_NAME);
-    if (ensure_dir(path) < 0)
-        return -1;
-
-    char cpu_path[256];
-
-    snprintf(cpu_path, sizeof(cpu_path), "%s/%s/cpu.weight", CGROUP_ROOT, FOCUS_NAME);
-    if (write_file(cpu_path, "1000") < 0)
-        return -1;
-
-    snprintf(cpu_path, sizeof(cpu_path), "%s/%s/cpu.weight", CGROUP_ROOT, BG_NAME);
-    if (write_file(cpu_path, "10") < 0)
-        return -1;
-
-    if (ensure_dir(STATE_DIR) < 0)
+    else
+    {
+        fprintf(stderr, "Usage: profile [reset | <group> <knob> <value>]\n");
         return -1;
+    }
 
-    printf("Initialized focus and background cgroups (focus=1000, background=10).\n");
-    return 0;
+    return apply_saved_profile(&profile);
 }
 
-static int move_pid(const char *group, pid_t pid)
+static int cap_cmd(int argc, char **argv)
 {
-    char path[256];
-    snprintf(path, sizeof(path), "%s/%s/cgroup.procs", CGROUP_ROOT, group);
-
-    char buf[32];
-    snprintf(buf, sizeof(buf), "%d", pid);
-
-    if (write_file(path, buf) < 0)
+    if (argc < 1)
     {
-        fprintf(stderr, "Failed to move pid %d to %s\n", pid, group);
+        fprintf(stderr, "Usage: cap <quota_us|max> [period_us] [burst_us]\n");
         return -1;
     }
 
-    printf("Moved pid %d to %s group.\n", pid, group);
-    return 0;
-}
-
-static int move_pid_root(pid_t pid)
-{
-    char path[256];
-    snprintf(path, sizeof(path), "%s/cgroup.procs", CGROUP_ROOT);
-
-    char buf[32];
-    snprintf(buf, sizeof(buf), "%d", pid);
+    const char *quota = argv[0];
+    long period = (argc >= 2) ? atol(argv[1]) : CAP_DEFAULT_PERIOD_US;
+    long burst = (argc >= 3) ? atol(argv[2]) : 0;
 
-    if (write_file(path, buf) < 0)
+    if (strcmp(quota, "max") != 0 && (!is_number_str(quota) || atol(quota) <= 0))
     {
-        fprintf(stderr, "Failed to move pid %d to root cgroup\n", pid);
+        fprintf(stderr, "Quota must be a positive number of microseconds or \"max\"\n");
+        return -1;
+    }
+    if (period < 1000 || period > 1000000 || burst < 0)
+    {
+        fprintf(stderr, "Period must be 1000..1000000 us and burst >= 0\n");
         return -1;
     }
 
-    printf("Moved pid %d back to root cgroup (unfocused).\n", pid);
-    return 0;
-}
-
-static int reset_weights(void)
-{
-    char path[256];
-    snprintf(path, sizeof(path), "%s/%s/cpu.weight", CGROUP_ROOT, FOCUS_NAME);
-    if (write_file(path, "100") < 0)
+    struct focus_profile profile;
+    if (focus_load_profiles(&profile) < 0)
         return -1;
 
-    snprintf(path, sizeof(path), "%s/%s/cpu.weight", CGROUP_ROOT, BG_NAME);
-    if (write_file(path, "100") < 0)
+    char value[64];
+    snprintf(value, sizeof(value), "%s %ld", quota, period);
+    if (focus_profile_set(&profile, BG_NAME, "cpu.max", value) < 0)
+        return -1;
+    snprintf(value, sizeof(value), "%ld", burst);
+    if (focus_profile_set(&profile, BG_NAME, "cpu.max.burst", value) < 0)
         return -1;
 
-    printf("Reset cpu.weight of focus and background to 100.\n");
-    return 0;
+    if (focus_save_profiles(&profile) < 0)
+        return -1;
+    return apply_saved_profile(&profile);
 }
 
 static int print_file(const char *path)
@@ -218,72 +241,868 @@ static int status_cmd(void)
     return 0;
 }
 
-static int is_number_str(const char *s)
+/*
+ * top: live view of the lottery.
+ *
+ * Every descriptor (per-pid stat and cgroup, per-group cpu.stat and
+ * cpu.pressure) is opened once and re-read with pread(); the ticket
+ * state is tailed incrementally and win counts come from focusd's
+ * WINS_FILE mapping.  On a terminal only rows whose text changed since
+ * the previous frame are rewritten.
+ */
+
+#define TOP_LINE 160
+#define TOP_HEADER_ROWS 5
+
+struct top_row
 {
-    if (!s || !*s)
-        return 0;
-    for (const char *p = s; *p; p++)
+    pid_t pid;
+    int stat_fd;
+    int cgroup_fd;
+    int primed;
+    unsigned long seen;
+    unsigned long long cpu_ticks;
+    double cpu_pct;
+};
+
+struct top_rows
+{
+    struct top_row *slots;
+    int cap;
+    int used;
+};
+
+struct top_group
+{
+    const char *name;
+    int stat_fd;
+    int pressure_fd;
+    unsigned long long usage_usec;
+    double cpu_pct;
+    char pressure[48];
+};
+
+static volatile sig_atomic_t top_stop = 0;
+
+static void handle_top_stop(int sig)
+{
+    (void)sig;
+    top_stop = 1;
+}
+
+static ssize_t pread_str(int fd, char *buf, size_t size)
+{
+    if (fd < 0)
+        return -1;
+    ssize_t n = pread(fd, buf, size - 1, 0);
+    if (n < 0)
+        return -1;
+    buf[n] = '\0';
+    return n;
+}
+
+static int open_proc_file(pid_t pid, const char *name)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/%s", pid, name);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static struct top_row *top_row_get(struct top_rows *m, pid_t pid)
+{
+    if ((m->used + 1) * 2 > m->cap)
     {
-        if (!isdigit((unsigned char)*p))
-            return 0;
+        int cap = m->cap ? m->cap * 2 : 64;
+        struct top_row *slots = (struct top_row *)calloc((size_t)cap, sizeof(struct top_row));
+        if (!slots)
+            return NULL;
+        struct top_row *old = m->slots;
+        int old_cap = m->cap;
+        m->slots = slots;
+        m->cap = cap;
+        m->used = 0;
+        for (int i = 0; i < old_cap; i++)
+        {
+            if (old[i].pid > 0)
+            {
+                unsigned int mask = (unsigned int)cap - 1;
+                unsigned int h = ((unsigned int)old[i].pid * 2654435761u) & mask;
+                while (slots[h].pid != 0)
+                    h = (h + 1) & mask;
+                slots[h] = old[i];
+                m->used++;
+            }
+        }
+        free(old);
+    }
+
+    unsigned int mask = (unsigned int)m->cap - 1;
+    for (unsigned int h = ((unsigned int)pid * 2654435761u) & mask;; h = (h + 1) & mask)
+    {
+        struct top_row *r = &m->slots[h];
+        if (r->pid == pid)
+            return r;
+        if (r->pid == 0)
+        {
+            memset(r, 0, sizeof(*r));
+            r->pid = pid;
+            r->stat_fd = open_proc_file(pid, "stat");
+            r->cgroup_fd = open_proc_file(pid, "cgroup");
+            m->used++;
+            return r;
+        }
     }
-    return 1;
 }
 
-static int move_by_name(const char *group, const char *name)
+static void top_row_close(struct top_row *r)
+{
+    if (r->stat_fd >= 0)
+        close(r->stat_fd);
+    if (r->cgroup_fd >= 0)
+        close(r->cgroup_fd);
+}
+
+// Closes rows of pids that left the ticket state.
+static void top_rows_sweep(struct top_rows *m, unsigned long frame)
 {
-    DIR *d = opendir("/proc");
-    if (!d)
+    int stale = 0;
+    for (int i = 0; i < m->cap; i++)
     {
-        perror("opendir /proc");
-        return -1;
+        if (m->slots[i].pid > 0 && m->slots[i].seen != frame)
+            stale++;
+    }
+    if (stale == 0)
+        return;
+
+    struct top_row *old = m->slots;
+    int old_cap = m->cap;
+    m->slots = (struct top_row *)calloc((size_t)old_cap, sizeof(struct top_row));
+    m->used = 0;
+    if (!m->slots)
+    {
+        m->slots = old; // keep the stale rows rather than lose the live ones
+        return;
+    }
+    unsigned int mask = (unsigned int)old_cap - 1;
+    for (int i = 0; i < old_cap; i++)
+    {
+        if (old[i].pid <= 0)
+            continue;
+        if (old[i].seen != frame)
+        {
+            top_row_close(&old[i]);
+            continue;
+        }
+        unsigned int h = ((unsigned int)old[i].pid * 2654435761u) & mask;
+        while (m->slots[h].pid != 0)
+            h = (h + 1) & mask;
+        m->slots[h] = old[i];
+        m->used++;
+    }
+    free(old);
+}
+
+static void top_row_sample(struct top_row *r, double wall, long clk_tck)
+{
+    char buf[1024];
+    if (pread_str(r->stat_fd, buf, sizeof(buf)) <= 0)
+    {
+        r->cpu_pct = -1.0;
+        return;
+    }
+
+    char *p = strrchr(buf, ')');
+    if (!p)
+        return;
+    p += 2; // field 3
+    for (int field = 3; field < 14 && p; field++)
+    {
+        p = strchr(p, ' ');
+        if (p)
+            p++;
+    }
+    if (!p)
+        return;
+    char *end;
+    unsigned long long utime = strtoull(p, &end, 10);
+    unsigned long long ticks = utime + strtoull(end, NULL, 10);
+
+    if (r->primed && wall > 0.0)
+        r->cpu_pct = 100.0 * (double)(ticks - r->cpu_ticks) / ((double)clk_tck * wall);
+    r->cpu_ticks = ticks;
+    r->primed = 1;
+}
+
+// Copies the unified-hierarchy path of pid, e.g. "/background/f123".
+static void top_row_group(const struct top_row *r, char *out, size_t size)
+{
+    char buf[512];
+    snprintf(out, size, "-");
+    if (pread_str(r->cgroup_fd, buf, sizeof(buf)) <= 0)
+        return;
+    char *p = strstr(buf, "0::");
+    if (!p)
+        return;
+    p += 3;
+    p[strcspn(p, "\n")] = '\0';
+    snprintf(out, size, "%s", p);
+}
+
+static void top_group_open(struct top_group *g, const char *name)
+{
+    char path[256];
+    memset(g, 0, sizeof(*g));
+    g->name = name;
+    snprintf(path, sizeof(path), "%s/%s/cpu.stat", CGROUP_ROOT, name);
+    g->stat_fd = open(path, O_RDONLY | O_CLOEXEC);
+    snprintf(path, sizeof(path), "%s/%s/cpu.pressure", CGROUP_ROOT, name);
+    g->pressure_fd = open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static void top_group_sample(struct top_group *g, double wall)
+{
+    char buf[512];
+    if (pread_str(g->stat_fd, buf, sizeof(buf)) > 0)
+    {
+        char *p = strstr(buf, "usage_usec ");
+        unsigned long long usage = p ? strtoull(p + 11, NULL, 10) : 0;
+        if (g->usage_usec && wall > 0.0)
+            g->cpu_pct = (double)(usage - g->usage_usec) / (wall * 1e4);
+        g->usage_usec = usage;
+    }
+
+    double some = 0.0, full = 0.0;
+    if (pread_str(g->pressure_fd, buf, sizeof(buf)) > 0)
+    {
+        char *p = strstr(buf, "some avg10=");
+        if (p)
+            some = atof(p + 11);
+        p = strstr(buf, "full avg10=");
+        if (p)
+            full = atof(p + 11);
+        snprintf(g->pressure, sizeof(g->pressure), "some %5.2f%% full %5.2f%%", some, full);
+    }
+    else
+    {
+        snprintf(g->pressure, sizeof(g->pressure), "n/a");
+    }
+}
+
+
+// Output of one frame; lines[] holds what is on screen from the last one.
+struct top_screen
+{
+    int tty;
+    int rows;
+    int row;
+    char (*lines)[TOP_LINE];
+    char *out;
+    size_t len;
+    size_t cap;
+};
+
+static void top_append(struct top_screen *scr, const char *fmt, int row, const char *line)
+{
+    size_t need = scr->len + strlen(line) + 32;
+    if (need > scr->cap)
+    {
+        char *out = (char *)realloc(scr->out, need * 2);
+        if (!out)
+            return;
+        scr->out = out;
+        scr->cap = need * 2;
+    }
+    if (scr->tty)
+        scr->len += (size_t)sprintf(scr->out + scr->len, fmt, row + 1, line);
+    else
+        scr->len += (size_t)sprintf(scr->out + scr->len, "%s\n", line);
+}
+
+// Queues line as the next row; on a terminal unchanged rows cost nothing.
+static void top_emit(struct top_screen *scr, const char *line)
+{
+    if (scr->row < scr->rows && (!scr->tty || strcmp(scr->lines[scr->row], line) != 0))
+    {
+        top_append(scr, "\033[%d;1H%s\033[K", scr->row, line);
+        snprintf(scr->lines[scr->row], TOP_LINE, "%s", line);
+    }
+    scr->row++;
+}
+
+static int top_cmd(int argc, char **argv)
+{
+    double interval = 1.0;
+    long iterations = -1;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+            interval = atof(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            iterations = atol(argv[++i]);
+        else
+        {
+            fprintf(stderr, "Usage: focusctl top [-d seconds] [-n iterations]\n");
+            return 1;
+        }
+    }
+    if (interval < 0.1)
+        interval = 0.1;
+
+    focus_raise_nofile();
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_top_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    long clk_tck = sysconf(_SC_CLK_TCK);
+    struct top_group groups[2];
+    top_group_open(&groups[0], FOCUS_NAME);
+    top_group_open(&groups[1], BG_NAME);
+
+    struct top_rows rows;
+    memset(&rows, 0, sizeof(rows));
+    const struct ticket_entry *arr = NULL;
+    int count = 0;
+    struct focus_ticket_reader *tickets = focus_tickets_open();
+    struct focus_wins *wins = NULL;
+    if (!tickets)
+        return 1;
+
+    struct top_screen scr;
+    memset(&scr, 0, sizeof(scr));
+    scr.tty = isatty(STDOUT_FILENO);
+
+    struct timespec last;
+    clock_gettime(CLOCK_MONOTONIC, &last);
+    if (scr.tty)
+        fputs("\033[?25l\033[H\033[2J", stdout);
+
+    for (unsigned long frame = 1; !top_stop && iterations != 0; frame++)
+    {
+        if (iterations > 0)
+            iterations--;
+
+        if (focus_tickets_poll(tickets, &arr, &count) < 0)
+            count = 0;
+        if (!wins)
+            wins = focus_wins_map(0);
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double wall = (double)(now.tv_sec - last.tv_sec) + (double)(now.tv_nsec - last.tv_nsec) / 1e9;
+        last = now;
+
+        for (int g = 0; g < 2; g++)
+            top_group_sample(&groups[g], wall);
+
+        int term_rows = 0;
+        struct winsize ws;
+        if (scr.tty && ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0)
+            term_rows = ws.ws_row;
+        int max_rows = scr.tty ? term_rows : TOP_HEADER_ROWS + count;
+        if (scr.tty && max_rows <= TOP_HEADER_ROWS)
+            max_rows = TOP_HEADER_ROWS + 1;
+
+        if (max_rows != scr.rows)
+        {
+            // resized: forget the old frame and repaint everything
+            free(scr.lines);
+            scr.lines = (char (*)[TOP_LINE])calloc((size_t)max_rows, TOP_LINE);
+            scr.rows = scr.lines ? max_rows : 0;
+            if (scr.tty)
+                fputs("\033[H\033[2J", stdout);
+        }
+        scr.len = 0;
+        scr.row = 0;
+        char line[TOP_LINE];
+        uint64_t total_ticks = wins ? wins->ticks : 0;
+
+        snprintf(line, sizeof(line), "focusctl top - %d managed pids, %llu lottery draws%s", count,
+                 (unsigned long long)total_ticks, wins ? "" : " (focusd not running)");
+        top_emit(&scr, line);
+        for (int g = 0; g < 2; g++)
+        {
+            char cpu[16];
+            if (groups[g].stat_fd < 0)
+                snprintf(cpu, sizeof(cpu), "n/a");
+            else
+                snprintf(cpu, sizeof(cpu), "%.1f%%", groups[g].cpu_pct);
+            snprintf(line, sizeof(line), "%-10s cpu %8s  pressure %s", groups[g].name, cpu,
+                     groups[g].pressure);
+            top_emit(&scr, line);
+        }
+        line[0] = '\0';
+        top_emit(&scr, line);
+        snprintf(line, sizeof(line), "%8s %8s %10s %6s %7s  %s", "PID", "TICKETS", "WINS", "WIN%",
+                 "CPU%", "CGROUP");
+        top_emit(&scr, line);
+
+        for (int i = 0; i < count; i++)
+        {
+            struct top_row *r = top_row_get(&rows, arr[i].pid);
+            if (!r)
+                continue;
+            r->seen = frame;
+            top_row_sample(r, wall, clk_tck);
+            if (scr.row >= scr.rows)
+                continue; // sampled so the next frame has a delta, but off screen
+
+            char cg[64];
+            char cpu[16];
+            top_row_group(r, cg, sizeof(cg));
+            uint64_t w = wins ? focus_wins_get(wins, arr[i].pid) : 0;
+            if (r->cpu_pct < 0.0)
+                snprintf(cpu, sizeof(cpu), "gone");
+            else
+                snprintf(cpu, sizeof(cpu), "%.1f", r->cpu_pct);
+            snprintf(line, sizeof(line), "%8d %8d %10llu %6.1f %7s  %s", arr[i].pid, arr[i].tickets,
+                     (unsigned long long)w, total_ticks ? 100.0 * (double)w / (double)total_ticks : 0.0,
+                     cpu, cg);
+            top_emit(&scr, line);
+        }
+        top_rows_sweep(&rows, frame);
+
+        if (scr.tty)
+        {
+            // blank rows left over from a longer previous frame
+            for (; scr.row < scr.rows && scr.lines[scr.row][0] != '\0'; scr.row++)
+            {
+                scr.lines[scr.row][0] = '\0';
+                top_append(&scr, "\033[%d;1H%s\033[K", scr.row, "");
+            }
+        }
+        else
+        {
+            top_append(&scr, "%s", 0, "");
+        }
+
+        fflush(stdout);
+        if (scr.len > 0 && write(STDOUT_FILENO, scr.out, scr.len) < 0)
+            break;
+
+        if (iterations != 0)
+            usleep((useconds_t)(interval * 1e6));
+    }
+
+    if (scr.tty)
+        printf("\033[%d;1H\033[?25h\n", scr.rows);
+
+    for (int i = 0; i < rows.cap; i++)
+    {
+        if (rows.slots[i].pid > 0)
+            top_row_close(&rows.slots[i]);
+    }
+    for (int g = 0; g < 2; g++)
+    {
+        if (groups[g].stat_fd >= 0)
+            close(groups[g].stat_fd);
+        if (groups[g].pressure_fd >= 0)
+            close(groups[g].pressure_fd);
+    }
+    focus_wins_unmap(wins);
+    free(rows.slots);
+    free(scr.lines);
+    free(scr.out);
+    focus_tickets_close(tickets);
+    return 0;
+}
+
+static void print_rules(const struct focus_rules *rules)
+{
+    char buf[256];
+    if (focus_rules_count(rules) == 0)
+    {
+        printf("No placement rules in %s.\n", RULES_FILE);
+        return;
+    }
+    for (int i = 0; i < focus_rules_count(rules); i++)
+    {
+        focus_rule_format(focus_rules_get(rules, i), buf, sizeof(buf));
+        printf("%3d  %s\n", i + 1, buf);
     }
+}
 
-    struct dirent *ent;
-    int moved = 0;
+// Rewrites RULES_FILE without its n-th rule (1-based), keeping comments.
+static int delete_rule(int n)
+{
+    FILE *in = fopen(RULES_FILE, "r");
+    if (!in)
+    {
+        perror(RULES_FILE);
+        return -1;
+    }
+    char tmp[sizeof(RULES_FILE) + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", RULES_FILE);
+    FILE *out = fopen(tmp, "w");
+    if (!out)
+    {
+        perror(tmp);
+        fclose(in);
+        return -1;
+    }
 
-    while ((ent = readdir(d)) != NULL)
+    char line[512];
+    int seen = 0;
+    int deleted = 0;
+    while (fgets(line, sizeof(line), in))
     {
-        if (!is_number_str(ent->d_name))
+        struct focus_rule rule;
+        if (focus_rule_parse(line, &rule) == 0 && ++seen == n)
+        {
+            deleted = 1;
             continue;
+        }
+        fputs(line, out);
+    }
+    fclose(in);
+    if (fclose(out) != 0 || !deleted || rename(tmp, RULES_FILE) < 0)
+    {
+        if (!deleted)
+            fprintf(stderr, "No rule %d\n", n);
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
 
-        pid_t pid = (pid_t)atoi(ent->d_name);
-        char comm_path[256];
-        snprintf(comm_path, sizeof(comm_path), "/proc/%d/comm", pid);
+// Dry run: prints every running process the rules would place.
+static int test_rules(const struct focus_rules *rules)
+{
+    struct focus_proc_cache cache = {NULL, 0, NULL, 0};
+    if (focus_scan_procs(&cache, focus_rules_want(rules), NULL, NULL) < 0)
+        return -1;
 
-        FILE *f = fopen(comm_path, "r");
-        if (!f)
+    int matched = 0;
+    char buf[256];
+    for (int i = 0; i < cache.count; i++)
+    {
+        const struct focus_proc_info *pi = &cache.items[i];
+        const struct focus_proc_info *parent = focus_proc_cache_lookup(&cache, pi->ppid);
+        int r = focus_rules_match(rules, pi, parent ? parent->comm : NULL);
+        if (r < 0)
             continue;
+        focus_rule_format(focus_rules_get(rules, r), buf, sizeof(buf));
+        printf("%8d %-16s rule %d: %s\n", pi->pid, pi->comm, r + 1, buf);
+        matched++;
+    }
+    printf("%d of %d processes match.\n", matched, cache.count);
+    focus_proc_cache_free(&cache);
+    return 0;
+}
 
-        char comm[256] = {0};
-        if (fgets(comm, sizeof(comm), f) == NULL)
+static int rules_cmd(int argc, char **argv)
+{
+    if (argc >= 4 && strcmp(argv[0], "add") == 0)
+    {
+        struct focus_rule rule;
+        char line[512];
+        // quote the pattern so it survives the round trip through the file
+        snprintf(line, sizeof(line), "%s \"%s\" %s %s", argv[1], argv[2], argv[3],
+                 argc >= 5 ? argv[4] : "");
+        if (focus_rule_parse(line, &rule) != 0)
         {
-            fclose(f);
-            continue;
+            fprintf(stderr,
+                    "Invalid rule. Fields: comm, cmdline, exe, parent, uid; groups: %s, %s or -\n",
+                    FOCUS_NAME, BG_NAME);
+            return 1;
+        }
+        if (focus_ensure_dir(STATE_DIR) < 0)
+            return 1;
+        FILE *f = fopen(RULES_FILE, "a");
+        if (!f)
+        {
+            perror(RULES_FILE);
+            return 1;
         }
-        fclose(f);
+        focus_rule_format(&rule, line, sizeof(line));
+        fprintf(f, "%s\n", line);
+        if (fclose(f) != 0)
+        {
+            perror(RULES_FILE);
+            return 1;
+        }
+        printf("Added rule: %s\n", line);
+        return 0;
+    }
+    if (argc >= 2 && strcmp(argv[0], "del") == 0)
+    {
+        return delete_rule(atoi(argv[1])) < 0 ? 1 : 0;
+    }
+
+    struct focus_rules *rules = focus_rules_load();
+    if (!rules)
+        return 1;
+    int rc = 0;
+    if (argc >= 1 && strcmp(argv[0], "test") == 0)
+        rc = test_rules(rules) < 0 ? 1 : 0;
+    else if (argc == 0)
+        print_rules(rules);
+    else
+    {
+        fprintf(stderr, "Usage: focusctl rules [add <field> <pattern> <group|-> [tickets]\n"
+                        "                      | del <n> | test]\n");
+        rc = 1;
+    }
+    focus_rules_free(rules);
+    return rc;
+}
+
+/*
+ * focusctl trace: decodes focusd's decision ring (TRACE_FILE).  The
+ * default is a summary of the newest records; --csv prints one line per
+ * tick instead, for post-mortem analysis in other tools.
+ */
+
+struct trace_winner
+{
+    pid_t pid;
+    unsigned long ticks;
+};
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : (x > y);
+}
+
+static int cmp_winner_pid(const void *a, const void *b)
+{
+    pid_t x = ((const struct trace_winner *)a)->pid;
+    pid_t y = ((const struct trace_winner *)b)->pid;
+    return x < y ? -1 : (x > y);
+}
+
+static int cmp_winner_ticks(const void *a, const void *b)
+{
+    unsigned long x = ((const struct trace_winner *)a)->ticks;
+    unsigned long y = ((const struct trace_winner *)b)->ticks;
+    return x > y ? -1 : (x < y);
+}
+
+static void format_trace_time(uint64_t ns, char *out, size_t size)
+{
+    time_t sec = (time_t)(ns / 1000000000ULL);
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    size_t len = strftime(out, size, "%Y-%m-%d %H:%M:%S", &tm);
+    snprintf(out + len, size - len, ".%03u", (unsigned int)(ns / 1000000ULL % 1000));
+}
+
+static void trace_csv(const struct focus_trace_record *recs, int n)
+{
+    printf("seq,time_ns,late_us,duration_us,entries,tickets,writes,failures,held,winners\n");
+    for (int i = 0; i < n; i++)
+    {
+        const struct focus_trace_record *r = &recs[i];
+        printf("%llu,%llu,%u,%u,%u,%u,%u,%u,%u,", (unsigned long long)r->seq,
+               (unsigned long long)r->time_ns, r->late_us, r->duration_us, r->entries, r->tickets,
+               r->writes, r->failures, r->held);
+        int shown = r->nwinners < FOCUS_TRACE_WINNERS ? r->nwinners : FOCUS_TRACE_WINNERS;
+        for (int j = 0; j < shown; j++)
+            printf("%s%d", j ? ";" : "", r->winners[j]);
+        printf("\n");
+    }
+}
+
+// Prints avg/p50/p99/max of vals, which is sorted in place.
+static void print_trace_dist(const char *what, uint32_t *vals, int n)
+{
+    double sum = 0.0;
+    for (int i = 0; i < n; i++)
+        sum += vals[i];
+    qsort(vals, (size_t)n, sizeof(uint32_t), cmp_u32);
+    printf("%-15s avg %8.1f us  p50 %7u us  p99 %7u us  max %7u us\n", what, sum / n,
+           vals[n / 2], vals[(int)((n - 1) * 0.99)], vals[n - 1]);
+}
 
-        size_t len = strlen(comm);
-        if (len > 0 && comm[len - 1] == '\n')
-            comm[len - 1] = '\0';
+static int trace_summary(const struct focus_trace_record *recs, int n, uint64_t total)
+{
+    uint32_t *vals = (uint32_t *)malloc(sizeof(uint32_t) * n);
+    struct trace_winner *won =
+        (struct trace_winner *)malloc(sizeof(struct trace_winner) * n * FOCUS_TRACE_WINNERS);
+    if (!vals || !won)
+    {
+        free(vals);
+        free(won);
+        fprintf(stderr, "Out of memory.\n");
+        return -1;
+    }
 
-        if (strstr(comm, name) != NULL)
+    char from[64], to[64];
+    format_trace_time(recs[0].time_ns, from, sizeof(from));
+    format_trace_time(recs[n - 1].time_ns, to, sizeof(to));
+    printf("%d ticks from %s to %s (%.1f s)", n, from, to,
+           (recs[n - 1].time_ns - recs[0].time_ns) / 1e9);
+    if (total > (uint64_t)n)
+        printf(", %llu older ticks not shown", (unsigned long long)(total - n));
+    printf("\n");
+
+    for (int i = 0; i < n; i++)
+        vals[i] = recs[i].duration_us;
+    print_trace_dist("tick duration", vals, n);
+    for (int i = 0; i < n; i++)
+        vals[i] = recs[i].late_us;
+    print_trace_dist("wakeup late", vals, n);
+
+    unsigned long writes = 0, failures = 0, held = 0, focused = 0, switches = 0;
+    double tickets = 0.0, entries = 0.0;
+    int nwon = 0;
+    int truncated = 0;
+    for (int i = 0; i < n; i++)
+    {
+        writes += recs[i].writes;
+        failures += recs[i].failures;
+        tickets += recs[i].tickets;
+        entries += recs[i].entries;
+        held += recs[i].held;
+        focused += recs[i].nwinners;
+        truncated |= recs[i].nwinners > FOCUS_TRACE_WINNERS;
+        // a winner that was not focused the tick before is a switch
+        for (int j = 0; i > 0 && j < recs[i].nwinners && j < FOCUS_TRACE_WINNERS; j++)
         {
-            move_pid(group, pid);
-            moved++;
+            int kept = 0;
+            for (int m = 0; m < recs[i - 1].nwinners && m < FOCUS_TRACE_WINNERS; m++)
+                kept |= recs[i - 1].winners[m] == recs[i].winners[j];
+            switches += !kept;
         }
+        for (int j = 0; j < recs[i].nwinners && j < FOCUS_TRACE_WINNERS; j++)
+        {
+            won[nwon].pid = recs[i].winners[j];
+            won[nwon++].ticks = 1;
+        }
+    }
+    printf("backend writes  %lu (%lu failed), %.2f per tick\n", writes, failures,
+           (double)writes / n);
+    printf("lottery         %.1f tickets over %.1f pids on average\n", tickets / n, entries / n);
+    printf("focus switches  %lu (%.2f per tick), %lu of %lu focus slices held\n", switches,
+           (double)switches / n, held, focused);
+
+    // count wins per pid: sort by pid, fold runs, then rank
+    qsort(won, (size_t)nwon, sizeof(struct trace_winner), cmp_winner_pid);
+    int distinct = 0;
+    for (int i = 0; i < nwon; i++)
+    {
+        if (distinct > 0 && won[distinct - 1].pid == won[i].pid)
+            won[distinct - 1].ticks++;
+        else
+            won[distinct++] = won[i];
     }
+    qsort(won, (size_t)distinct, sizeof(struct trace_winner), cmp_winner_ticks);
+
+    printf("\n%-8s %10s %7s\n", "PID", "FOCUSED", "SHARE");
+    for (int i = 0; i < distinct && i < 10; i++)
+        printf("%-8d %10lu %6.1f%%\n", won[i].pid, won[i].ticks, 100.0 * won[i].ticks / n);
+    if (distinct > 10)
+        printf("... %d more pids\n", distinct - 10);
+    if (truncated)
+        printf("(ticks with more than %d winners only list the first %d)\n", FOCUS_TRACE_WINNERS,
+               FOCUS_TRACE_WINNERS);
+
+    free(vals);
+    free(won);
+    return 0;
+}
 
-    closedir(d);
+static int trace_cmd(int argc, char **argv)
+{
+    int max = FOCUS_TRACE_RECORDS;
+    int csv = 0;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            max = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--csv") == 0)
+            csv = 1;
+        else
+            max = -1;
+    }
+    if (max <= 0)
+    {
+        fprintf(stderr, "Usage: focusctl trace [-n ticks] [--csv]\n");
+        return 1;
+    }
+    if (max > FOCUS_TRACE_RECORDS)
+        max = FOCUS_TRACE_RECORDS;
 
-    if (moved == 0)
+    struct focus_trace *trace = focus_trace_map(0);
+    if (!trace)
+    {
+        fprintf(stderr, "No trace at %s; it is written by focusd.\n", TRACE_FILE);
+        return 1;
+    }
+    struct focus_trace_record *recs =
+        (struct focus_trace_record *)malloc(sizeof(struct focus_trace_record) * max);
+    if (!recs)
+    {
+        focus_trace_unmap(trace);
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+
+    uint64_t total = trace->next;
+    int n = focus_trace_read(trace, recs, max);
+    focus_trace_unmap(trace);
+
+    int rc = 0;
+    if (csv)
+        trace_csv(recs, n);
+    else if (n == 0)
+        printf("The trace is empty.\n");
+    else
+        rc = trace_summary(recs, n, total) < 0 ? 1 : 0;
+    free(recs);
+    return rc;
+}
+
+struct name_match
+{
+    const char *name;
+    const char *group;
+    int tickets;
+    int matched;
+    struct focus_txn *txn;
+};
+
+static int move_match_visit(const struct focus_proc_info *pi, void *arg)
+{
+    struct name_match *m = (struct name_match *)arg;
+    if (strstr(pi->comm, m->name) != NULL)
+    {
+        if (focus_txn_place(m->txn, pi->pid, m->group) < 0)
+            return -1;
+        m->matched++;
+    }
+    return 0;
+}
+
+static int move_by_name(const char *group, const char *name)
+{
+    struct focus_proc_cache cache = {NULL, 0, NULL, 0};
+    struct name_match m = {name, group, 0, 0, focus_txn_begin()};
+    if (!m.txn)
+        return -1;
+
+    int rc = focus_scan_procs(&cache, 0, move_match_visit, &m);
+    focus_proc_cache_free(&cache);
+    if (rc < 0)
+    {
+        focus_txn_abort(m.txn);
+        return -1;
+    }
+    if (focus_txn_commit(m.txn) < 0)
+        fprintf(stderr, "Some processes could not be moved to %s.\n", group);
+
+    if (m.matched == 0)
     {
         printf("No processes found with name containing \"%s\".\n", name);
     }
     else
     {
         printf("Moved %d processes matching \"%s\" to %s group.\n",
-               moved, name, group);
+               m.matched, name, group);
     }
     return 0;
 }
@@ -307,6 +1126,9 @@ static int pomodoro_cmd(int minutes, int npids, char **pid_args)
         return -1;
     }
 
+    struct focus_txn *txn = focus_txn_begin();
+    if (!txn)
+        return -1;
     for (int i = 0; i < npids; i++)
     {
         if (!is_number_str(pid_args[i]))
@@ -314,9 +1136,10 @@ static int pomodoro_cmd(int minutes, int npids, char **pid_args)
             fprintf(stderr, "Invalid pid: %s\n", pid_args[i]);
             continue;
         }
-        pid_t pid = (pid_t)atoi(pid_args[i]);
-        move_pid(FOCUS_NAME, pid);
+        focus_txn_place(txn, (pid_t)atoi(pid_args[i]), FOCUS_NAME);
     }
+    if (focus_txn_commit(txn) < 0)
+        fprintf(stderr, "Some processes could not be moved to %s.\n", FOCUS_NAME);
 
     int total_seconds = minutes * 60;
     printf("Pomodoro started for %d minute(s). Focus group boosted.\n", minutes);
@@ -379,119 +1202,38 @@ static int stop_all_focus(int force)
     return 0;
 }
 
-static int load_ticket_entries(struct ticket_entry *arr, int max_entries, int *out_count)
+static int cmd_add(pid_t pid, int tickets)
 {
-    *out_count = 0;
-
-    FILE *f = fopen(PROCS_FILE, "r");
-    if (!f)
+    if (tickets <= 0)
     {
-        if (errno == ENOENT)
-        {
-            return 0;
-        }
-        perror(PROCS_FILE);
+        fprintf(stderr, "Tickets must be > 0\n");
         return -1;
     }
 
-    int count = 0;
-    while (count < max_entries)
-    {
-        int pid_i = 0;
-        int tickets = 0;
-        int n = fscanf(f, "%d %d", &pid_i, &tickets);
-        if (n == EOF)
-            break;
-        if (n != 2)
-        {
-            char buf[256];
-            if (!fgets(buf, sizeof(buf), f))
-                break;
-            continue;
-        }
-        if (tickets <= 0)
-            continue;
-
-        arr[count].pid = (pid_t)pid_i;
-        arr[count].tickets = tickets;
-        count++;
-    }
-
-    fclose(f);
-    *out_count = count;
-    return 0;
-}
-
-static int save_ticket_entries(struct ticket_entry *arr, int count)
-{
-    if (ensure_dir(STATE_DIR) < 0)
-        return -1;
-
-    FILE *f = fopen(PROCS_FILE, "w");
-    if (!f)
+    // one journal append; the state is not read to tell add from update
+    struct focus_txn *txn = focus_txn_begin();
+    if (!txn || focus_txn_set_tickets(txn, pid, tickets) < 0)
     {
-        perror(PROCS_FILE);
+        focus_txn_abort(txn);
         return -1;
     }
-
-    for (int i = 0; i < count; i++)
-    {
-        if (arr[i].tickets <= 0 || arr[i].pid <= 0)
-            continue;
-        fprintf(f, "%d %d\n", arr[i].pid, arr[i].tickets);
-    }
-
-    if (fclose(f) != 0)
-    {
-        perror("fclose");
+    if (focus_txn_commit(txn) < 0)
         return -1;
-    }
+
+    printf("Set pid %d to %d tickets.\n", pid, tickets);
     return 0;
 }
 
-static int cmd_add(pid_t pid, int tickets)
+static int add_match_visit(const struct focus_proc_info *pi, void *arg)
 {
-    if (tickets <= 0)
+    struct name_match *m = (struct name_match *)arg;
+    if (strstr(pi->comm, m->name) != NULL)
     {
-        fprintf(stderr, "Tickets must be > 0\n");
-        return -1;
-    }
-
-    struct ticket_entry entries[1024];
-    int count = 0;
-    if (load_ticket_entries(entries, 1024, &count) < 0)
-        return -1;
-
-    int found = 0;
-    for (int i = 0; i < count; i++)
-    {
-        if (entries[i].pid == pid)
-        {
-            entries[i].tickets = tickets;
-            found = 1;
-            break;
-        }
-    }
-    if (!found)
-    {
-        if (count >= 1024)
-        {
-            fprintf(stderr, "Too many managed processes.\n");
+        if (focus_txn_set_tickets(m->txn, pi->pid, m->tickets) < 0)
             return -1;
-        }
-        entries[count].pid = pid;
-        entries[count].tickets = tickets;
-        count++;
+        printf("Queued pid %d (%s) with %d tickets.\n", pi->pid, pi->comm, m->tickets);
+        m->matched++;
     }
-
-    if (save_ticket_entries(entries, count) < 0)
-        return -1;
-
-    if (found)
-        printf("Updated pid %d tickets to %d.\n", pid, tickets);
-    else
-        printf("Added pid %d with %d tickets.\n", pid, tickets);
-
     return 0;
 }
 
@@ -503,81 +1245,43 @@ static int add_by_name(const char *name, int tickets)
         return -1;
     }
 
-    DIR *d = opendir("/proc");
-    if (!d)
-    {
-        perror("opendir /proc");
+    struct focus_proc_cache cache = {NULL, 0, NULL, 0};
+    struct name_match m = {name, NULL, tickets, 0, focus_txn_begin()};
+    if (!m.txn)
         return -1;
-    }
-
-    struct dirent *ent;
-    int added = 0;
 
-    while ((ent = readdir(d)) != NULL)
+    // all matches land in the state file with a single update
+    int rc = focus_scan_procs(&cache, 0, add_match_visit, &m);
+    focus_proc_cache_free(&cache);
+    if (rc < 0)
     {
-        if (!is_number_str(ent->d_name))
-            continue;
-
-        pid_t pid = (pid_t)atoi(ent->d_name);
-        char comm_path[256];
-        snprintf(comm_path, sizeof(comm_path), "/proc/%d/comm", pid);
-
-        FILE *f = fopen(comm_path, "r");
-        if (!f)
-            continue;
-
-        char comm[256] = {0};
-        if (!fgets(comm, sizeof(comm), f))
-        {
-            fclose(f);
-            continue;
-        }
-        fclose(f);
-
-        size_t len = strlen(comm);
-        if (len > 0 && comm[len - 1] == '\n')
-            comm[len - 1] = '\0';
-
-        if (strstr(comm, name) != NULL)
-        {
-            // reuse existing cmd_add(pid, tickets)
-            if (cmd_add(pid, tickets) == 0)
-            {
-                added++;
-            }
-        }
+        focus_txn_abort(m.txn);
+        return -1;
     }
+    if (focus_txn_commit(m.txn) < 0)
+        return -1;
 
-    closedir(d);
-
-    if (added == 0)
+    if (m.matched == 0)
     {
         printf("No processes found with name containing \"%s\".\n", name);
     }
     else
     {
         printf("Added/updated %d processes matching \"%s\" with %d tickets.\n",
-               added, name, tickets);
+               m.matched, name, tickets);
     }
     return 0;
 }
 
 static int cmd_remove(pid_t pid)
 {
-    struct ticket_entry entries[1024];
-    int count = 0;
-    if (load_ticket_entries(entries, 1024, &count) < 0)
-        return -1;
-
-    int new_count = 0;
-    for (int i = 0; i < count; i++)
+    struct focus_txn *txn = focus_txn_begin();
+    if (!txn || focus_txn_set_tickets(txn, pid, 0) < 0)
     {
-        if (entries[i].pid == pid)
-            continue;
-        entries[new_count++] = entries[i];
+        focus_txn_abort(txn);
+        return -1;
     }
-
-    if (save_ticket_entries(entries, new_count) < 0)
+    if (focus_txn_commit(txn) < 0)
         return -1;
 
     printf("Removed pid %d from lottery list (if it was present).\n", pid);
@@ -586,14 +1290,15 @@ static int cmd_remove(pid_t pid)
 
 static int cmd_list(void)
 {
-    struct ticket_entry entries[1024];
+    struct ticket_entry *entries = NULL;
     int count = 0;
-    if (load_ticket_entries(entries, 1024, &count) < 0)
+    if (focus_load_tickets(&entries, &count) < 0)
         return -1;
 
     if (count == 0)
     {
         printf("No processes registered for lottery scheduling.\n");
+        free(entries);
         return 0;
     }
 
@@ -603,6 +1308,7 @@ static int cmd_list(void)
     {
         printf("%d\t%d\n", entries[i].pid, entries[i].tickets);
     }
+    free(entries);
     return 0;
 }
 
@@ -625,10 +1331,16 @@ int main(int argc, char *argv[])
                 "  %s add <pid> <tickets>\n"
                 "  %s remove <pid>\n"
                 "  %s list\n"
-                "  %s add-name <substring> <tickets>\n",
+                "  %s add-name <substring> <tickets>\n"
+                "  %s profile [reset | <group> <knob> <value>]\n"
+                "  %s cap <quota_us|max> [period_us] [burst_us]\n"
+                "  %s top [-d seconds] [-n iterations]\n"
+                "  %s rules [add <field> <pattern> <group|-> [tickets] | del <n> | test]\n"
+                "  %s trace [-n ticks] [--csv]\n",
+                argv[0], argv[0], argv[0], argv[0], argv[0],
                 argv[0], argv[0], argv[0], argv[0], argv[0],
                 argv[0], argv[0], argv[0], argv[0], argv[0],
-                argv[0], argv[0], argv[0]);
+                argv[0], argv[0], argv[0], argv[0]);
         return 1;
     }
 
@@ -746,6 +1458,26 @@ int main(int argc, char *argv[])
     {
         return cmd_list();
     }
+    else if (strcmp(argv[1], "profile") == 0)
+    {
+        return profile_cmd(argc - 2, &argv[2]);
+    }
+    else if (strcmp(argv[1], "cap") == 0)
+    {
+        return cap_cmd(argc - 2, &argv[2]);
+    }
+    else if (strcmp(argv[1], "top") == 0)
+    {
+        return top_cmd(argc - 2, &argv[2]);
+    }
+    else if (strcmp(argv[1], "rules") == 0)
+    {
+        return rules_cmd(argc - 2, &argv[2]);
+    }
+    else if (strcmp(argv[1], "trace") == 0)
+    {
+        return trace_cmd(argc - 2, &argv[2]);
+    }
     else
     {
         fprintf(stderr, "Unknown command: %s\n", argv[1]);
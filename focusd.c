@@ -1,3 +1,6 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // SCHED_IDLE, SCHED_BATCH
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,240 +8,2490 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <ctype.h>
 #include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <math.h>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
 
-#define CGROUP_ROOT "/sys/fs/cgroup"
-#define FOCUS_NAME "focus"
-#define BG_NAME "background"
+#include "libfocus.h"
 
-#define STATE_DIR "/var/lib/focusctl"
-#define PROCS_FILE STATE_DIR "/procs.txt"
+// cn_proc.h nests its event enum in struct proc_event, which C++ scopes
+#ifdef __cplusplus
+#define EXEC_EVENT proc_event::PROC_EVENT_EXEC
+#define EXIT_EVENT proc_event::PROC_EVENT_EXIT
+#else
+#define EXEC_EVENT PROC_EVENT_EXEC
+#define EXIT_EVENT PROC_EVENT_EXIT
+#endif
 
-struct ticket_entry
+static struct timespec profiles_mtime;
+
+static void profiles_stat(struct timespec *out)
+{
+    struct stat st;
+    if (stat(PROFILES_FILE, &st) == 0)
+    {
+        *out = st.st_mtim;
+    }
+    else
+    {
+        out->tv_sec = 0;
+        out->tv_nsec = 0;
+    }
+}
+
+// Re-applies the profiles when PROFILES_FILE changes, before the tick's
+// placements, so winners always land in a fully configured group.
+static int reload_profiles_if_changed(void)
+{
+    struct timespec mtime;
+    profiles_stat(&mtime);
+    if (mtime.tv_sec == profiles_mtime.tv_sec && mtime.tv_nsec == profiles_mtime.tv_nsec)
+        return 0;
+    profiles_mtime = mtime;
+
+    struct focus_profile profile;
+    if (focus_load_profiles(&profile) == 0 && focus_apply_profiles(&profile) == 0)
+        printf("focusd: resource profiles reloaded from %s.\n", PROFILES_FILE);
+    return 1;
+}
+
+/*
+ * Adaptive background bandwidth cap (--cap-auto).
+ *
+ * Each tick the focus group's CPU demand is measured from the
+ * usage_usec delta of its cpu.stat.  The background quota is whatever
+ * is left of the machine after that demand plus CAP_HEADROOM, never
+ * below min_pct of one CPU.  With no focus demand background runs
+ * uncapped, so its throughput is only given up when focus needs it.
+ */
+
+#define CAP_PERIOD_US 100000
+#define CAP_HEADROOM 0.25
+#define CAP_STEP_US 1000
+
+struct cap_state
+{
+    int enabled;
+    int min_pct;
+    int stat_fd;
+    unsigned long long last_usage;
+    struct timespec last_ts;
+    double demand; // smoothed focus demand in CPUs
+    long long quota; // last written quota, 0 = "max", -1 = unknown
+};
+
+static double timespec_diff_sec(const struct timespec *a, const struct timespec *b)
+{
+    return (double)(a->tv_sec - b->tv_sec) + (double)(a->tv_nsec - b->tv_nsec) / 1e9;
+}
+
+static int read_cpu_usage(int fd, unsigned long long *usage)
+{
+    char buf[512];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0)
+        return -1;
+    buf[n] = '\0';
+
+    char *p = strstr(buf, "usage_usec ");
+    if (!p)
+        return -1;
+    *usage = strtoull(p + 11, NULL, 10);
+    return 0;
+}
+
+static int cap_auto_init(struct cap_state *cap, int min_pct)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s/cpu.stat", CGROUP_ROOT, FOCUS_NAME);
+
+    cap->stat_fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (cap->stat_fd < 0)
+    {
+        perror(path);
+        return -1;
+    }
+    if (read_cpu_usage(cap->stat_fd, &cap->last_usage) < 0)
+    {
+        fprintf(stderr, "Cannot parse %s\n", path);
+        close(cap->stat_fd);
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &cap->last_ts);
+    cap->enabled = 1;
+    cap->min_pct = min_pct;
+    cap->demand = 0.0;
+    cap->quota = -1;
+    return 0;
+}
+
+static void cap_auto_tick(struct cap_state *cap)
+{
+    unsigned long long usage;
+    struct timespec now;
+
+    if (read_cpu_usage(cap->stat_fd, &usage) < 0)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    double elapsed = timespec_diff_sec(&now, &cap->last_ts);
+    if (elapsed <= 0.0)
+        return;
+    double used = 0.0;
+    if (usage >= cap->last_usage)
+        used = (double)(usage - cap->last_usage) / 1e6 / elapsed;
+    cap->last_usage = usage;
+    cap->last_ts = now;
+
+    // rise immediately, decay slowly so bursts keep their room
+    if (used > cap->demand)
+        cap->demand = used;
+    else
+        cap->demand = 0.7 * cap->demand + 0.3 * used;
+
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    double room = (double)ncpu - cap->demand * (1.0 + CAP_HEADROOM);
+    long long quota = (long long)(room * CAP_PERIOD_US) / CAP_STEP_US * CAP_STEP_US;
+    long long floor = (long long)cap->min_pct * CAP_PERIOD_US / 100;
+    if (floor < CAP_STEP_US)
+        floor = CAP_STEP_US;
+    if (quota < floor)
+        quota = floor;
+    if (quota >= (long long)ncpu * CAP_PERIOD_US)
+        quota = 0;
+
+    if (quota == cap->quota)
+        return;
+
+    char path[256];
+    char value[64];
+    snprintf(path, sizeof(path), "%s/%s/cpu.max", CGROUP_ROOT, BG_NAME);
+    if (quota == 0)
+        snprintf(value, sizeof(value), "max %d", CAP_PERIOD_US);
+    else
+        snprintf(value, sizeof(value), "%lld %d", quota, CAP_PERIOD_US);
+    if (focus_write_file(path, value) == 0)
+        cap->quota = quota;
+}
+
+// The background cpu.max the profile asks for, or NULL if it sets none.
+static const char *profile_bg_cpu_max(const struct focus_profile *p)
+{
+    for (int i = 0; i < p->count; i++)
+    {
+        const struct profile_knob *k = &p->knobs[i];
+        if (strcmp(k->group, BG_NAME) == 0 && strcmp(k->knob, "cpu.max") == 0)
+            return k->value;
+    }
+    return NULL;
+}
+
+/*
+ * Gives background its profile cpu.max, or no cap if the profile sets
+ * none.  This is the baseline --cap-auto and --slo-p99 start from and
+ * return to; a cpu.max set by hand outside the profile is not kept.
+ */
+static void restore_bg_cpu_max(void)
+{
+    struct focus_profile profile;
+    char path[256];
+    char uncapped[32];
+    const char *value = uncapped;
+
+    snprintf(uncapped, sizeof(uncapped), "max %d", CAP_PERIOD_US);
+    if (focus_load_profiles(&profile) == 0 && profile_bg_cpu_max(&profile))
+        value = profile_bg_cpu_max(&profile);
+    snprintf(path, sizeof(path), "%s/%s/cpu.max", CGROUP_ROOT, BG_NAME);
+    focus_write_file(path, value);
+}
+
+static void cap_auto_restore(struct cap_state *cap)
+{
+    restore_bg_cpu_max();
+    close(cap->stat_fd);
+    cap->enabled = 0;
+}
+
+/*
+ * Freezer gang scheduling (--freeze group|pid).
+ *
+ * "group" freezes the whole background group for every slice that has a
+ * focus winner, so only focus runs; it is thawed again as soon as a slice
+ * has no winner or focusd goes idle, so processes placed in background by
+ * hand are not stopped for good.  "pid" gives each losing PID its own
+ * frozen child of background and thaws it again only when it wins.  Every
+ * freeze and thaw is timed until cgroup.events confirms the new state.
+ */
+
+#define FREEZE_NONE 0
+#define FREEZE_GROUP 1
+#define FREEZE_PID 2
+
+#define FREEZE_WAIT_MS 1000
+#define STATS_INTERVAL_SEC 10
+
+struct lat_stats
+{
+    unsigned long count;
+    unsigned long timeouts;
+    double sum_us;
+    double max_us;
+};
+
+struct freeze_state
+{
+    int mode;
+    int group_frozen;
+    pid_t *frozen; // FREEZE_PID: pids currently parked in a frozen child
+    int nfrozen;
+    int cap_frozen;
+    struct lat_stats freeze;
+    struct lat_stats thaw;
+};
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void lat_record(struct lat_stats *st, double us)
+{
+    st->count++;
+    st->sum_us += us;
+    if (us > st->max_us)
+        st->max_us = us;
+}
+
+static void lat_print(const char *what, const struct lat_stats *st)
+{
+    printf("%s n=%lu avg=%.1fus max=%.1fus timeouts=%lu", what, st->count,
+           st->count ? st->sum_us / st->count : 0.0, st->max_us, st->timeouts);
+}
+
+// Waits until <cgdir>/cgroup.events reports "frozen <want>".
+static int wait_frozen(const char *cgdir, int want)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/cgroup.events", cgdir);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    char expect[16];
+    snprintf(expect, sizeof(expect), "frozen %d", want);
+
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int rc = -1;
+    for (;;)
+    {
+        char buf[256];
+        ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+        if (n < 0)
+            break;
+        buf[n] = '\0';
+        if (strstr(buf, expect))
+        {
+            rc = 0;
+            break;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        int left = FREEZE_WAIT_MS - (int)(timespec_diff_sec(&now, &start) * 1000.0);
+        if (left <= 0)
+            break;
+        // kernfs signals cgroup.events changes with POLLPRI
+        struct pollfd pfd = {fd, POLLPRI, 0};
+        poll(&pfd, 1, left);
+    }
+    close(fd);
+    return rc;
+}
+
+static int set_frozen(const char *cgdir, int frozen, struct lat_stats *st)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/cgroup.freeze", cgdir);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (focus_write_file(path, frozen ? "1" : "0") < 0)
+        return -1;
+    if (wait_frozen(cgdir, frozen) < 0)
+    {
+        st->timeouts++;
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    lat_record(st, timespec_diff_sec(&end, &start) * 1e6);
+    return 0;
+}
+
+static void freeze_child_dir(pid_t pid, char *out, size_t size)
+{
+    snprintf(out, size, "%s/%s/f%d", CGROUP_ROOT, BG_NAME, pid);
+}
+
+static int freeze_find(const struct freeze_state *fz, pid_t pid)
+{
+    for (int i = 0; i < fz->nfrozen; i++)
+    {
+        if (fz->frozen[i] == pid)
+            return i;
+    }
+    return -1;
+}
+
+// Parks a losing pid in its own frozen child of background.
+static int freeze_pid(struct freeze_state *fz, pid_t pid)
+{
+    char dir[256];
+    char path[300];
+    char buf[32];
+
+    if (fz->nfrozen >= fz->cap_frozen)
+    {
+        int cap = fz->cap_frozen ? fz->cap_frozen * 2 : 16;
+        pid_t *tmp = (pid_t *)realloc(fz->frozen, sizeof(pid_t) * cap);
+        if (!tmp)
+            return -1;
+        fz->frozen = tmp;
+        fz->cap_frozen = cap;
+    }
+
+    freeze_child_dir(pid, dir, sizeof(dir));
+    if (focus_ensure_dir(dir) < 0)
+        return -1;
+    snprintf(path, sizeof(path), "%s/cgroup.procs", dir);
+    snprintf(buf, sizeof(buf), "%d", pid);
+    if (focus_write_file(path, buf) < 0)
+    {
+        rmdir(dir);
+        return -1;
+    }
+    fz->frozen[fz->nfrozen++] = pid;
+    return set_frozen(dir, 1, &fz->freeze);
+}
+
+// Thaws a parked pid and moves it to group (NULL leaves it in background).
+static void thaw_pid(struct freeze_state *fz, int idx, const char *group)
+{
+    pid_t pid = fz->frozen[idx];
+    char dir[256];
+
+    freeze_child_dir(pid, dir, sizeof(dir));
+    set_frozen(dir, 0, &fz->thaw);
+    focus_move_pid(group ? group : BG_NAME, pid);
+    rmdir(dir);
+    fz->frozen[idx] = fz->frozen[--fz->nfrozen];
+}
+
+static void freeze_group(struct freeze_state *fz, int frozen)
+{
+    char dir[256];
+    snprintf(dir, sizeof(dir), "%s/%s", CGROUP_ROOT, BG_NAME);
+    if (set_frozen(dir, frozen, frozen ? &fz->freeze : &fz->thaw) == 0 || !frozen)
+        fz->group_frozen = frozen;
+}
+
+// Releases everything focusd froze; run on exit so nothing stays stopped.
+static void thaw_all(struct freeze_state *fz)
+{
+    while (fz->nfrozen > 0)
+        thaw_pid(fz, fz->nfrozen - 1, NULL);
+    if (fz->group_frozen)
+        freeze_group(fz, 0);
+}
+
+static void print_freeze_stats(const struct freeze_state *fz)
+{
+    printf("focusd: ");
+    lat_print("freeze", &fz->freeze);
+    printf(" | ");
+    lat_print("thaw", &fz->thaw);
+    printf("\n");
+    fflush(stdout);
+}
+
+/*
+ * Actuation backends (--backend).
+ *
+ * A backend turns "this pid is in tier t" into a kernel setting.  Tier 0
+ * is focus and the last tier background; --tier adds groups in between.
+ * migrate moves the pid into the tier's group; weight parks every pid
+ * once in its own LOTTERY_NAME/p<pid> group and only sets that group's
+ * cpu.weight to the tier's (focus and background take theirs from the
+ * profile); nice spreads the tiers over nice 0..19 and
+ * sched-idle / sched-batch run middle tiers as SCHED_BATCH, so neither
+ * needs cgroup write access at all.  Placements are tracked per pid, so
+ * a backend is only called when a pid's placement actually changes.
+ */
+
+#define LOTTERY_NAME "lottery"
+#define TIER_PREFIX "tier-" // --tier groups, so uninstaller.sh can find them
+
+#define NICE_FOCUS 0
+#define NICE_BACKGROUND 19
+
+#define MAX_TIERS 8
+
+// placement states are tier indexes, plus parked in the freezer
+#define PLACE_FOCUS 0
+#define PLACE_FROZEN MAX_TIERS
+
+struct tier
+{
+    char name[32];
+    int weight;
+    int size; // places per slice; the last tier takes the rest
+};
+
+static struct tier tiers[MAX_TIERS] = {{FOCUS_NAME, 1000, 1}, {BG_NAME, 10, 0}};
+static int ntiers = 2;
+
+static int bg_tier(void)
+{
+    return ntiers - 1;
+}
+
+// Parses NAME:WEIGHT:COUNT and inserts it just above background.
+static int tier_add(const char *spec)
+{
+    struct tier t;
+    char name[24];
+    memset(&t, 0, sizeof(t));
+    if (sscanf(spec, "%23[^:]:%d:%d", name, &t.weight, &t.size) != 3 || t.weight < 1 ||
+        t.weight > 10000 || t.size <= 0 || strchr(name, '/') || name[0] == '.')
+    {
+        fprintf(stderr, "--tier takes NAME:WEIGHT:COUNT with WEIGHT 1..10000, COUNT > 0\n");
+        return -1;
+    }
+    snprintf(t.name, sizeof(t.name), "%s%s", TIER_PREFIX, name);
+    for (int i = 0; i < ntiers; i++)
+    {
+        if (strcmp(tiers[i].name, t.name) == 0)
+        {
+            fprintf(stderr, "--tier: %s is already a tier\n", name);
+            return -1;
+        }
+    }
+    if (ntiers >= MAX_TIERS)
+    {
+        fprintf(stderr, "--tier: at most %d tiers\n", MAX_TIERS);
+        return -1;
+    }
+    tiers[ntiers] = tiers[ntiers - 1];
+    tiers[ntiers - 1] = t;
+    ntiers++;
+    return 0;
+}
+
+// Creates the middle tiers' groups next to focus and background.
+static int tiers_init_groups(void)
+{
+    for (int i = 1; i < bg_tier(); i++)
+    {
+        char path[256];
+        char value[32];
+        snprintf(path, sizeof(path), "%s/%s", CGROUP_ROOT, tiers[i].name);
+        if (focus_ensure_dir(path) < 0)
+            return -1;
+        snprintf(path, sizeof(path), "%s/%s/cpu.weight", CGROUP_ROOT, tiers[i].name);
+        snprintf(value, sizeof(value), "%d", tiers[i].weight);
+        if (focus_write_file(path, value) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+// Hands the middle tiers' members to background and removes their groups.
+static void tiers_remove_groups(void)
+{
+    for (int i = 1; i < bg_tier(); i++)
+    {
+        char path[256];
+        pid_t *members = NULL;
+        int n = 0;
+        if (focus_group_members(tiers[i].name, &members, &n) == 0)
+        {
+            for (int j = 0; j < n; j++)
+                focus_move_pid(BG_NAME, members[j]);
+        }
+        free(members);
+        snprintf(path, sizeof(path), "%s/%s", CGROUP_ROOT, tiers[i].name);
+        if (rmdir(path) < 0 && errno != ENOENT)
+            perror(path);
+    }
+}
+
+struct actuator
+{
+    const char *name;
+    int cgroups; // needs the focus/background cgroups and profiles
+    int (*init)(void);
+    int (*place)(pid_t pid, int tier);
+    int (*release)(pid_t pid); // pid left the lottery
+};
+
+struct sched_attr_compat
+{
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t sched_nice;
+    uint32_t sched_priority;
+    uint64_t sched_runtime;
+    uint64_t sched_deadline;
+    uint64_t sched_period;
+};
+
+static int sched_bg_policy = SCHED_IDLE;
+
+static int migrate_place(pid_t pid, int tier)
+{
+    return focus_move_pid(tiers[tier].name, pid);
+}
+
+static int migrate_release(pid_t pid)
+{
+    (void)pid;
+    return 0;
+}
+
+// Focus and background weights come from the profile, as with migrate.
+static void weight_load_profile(void)
+{
+    struct focus_profile profile;
+    if (focus_load_profiles(&profile) < 0)
+        return;
+    for (int i = 0; i < profile.count; i++)
+    {
+        const struct profile_knob *k = &profile.knobs[i];
+        int weight = atoi(k->value);
+        if (strcmp(k->knob, "cpu.weight") != 0 || weight <= 0)
+            continue;
+        if (strcmp(k->group, FOCUS_NAME) == 0)
+            tiers[PLACE_FOCUS].weight = weight;
+        else if (strcmp(k->group, BG_NAME) == 0)
+            tiers[bg_tier()].weight = weight;
+    }
+}
+
+static int weight_init(void)
+{
+    char path[256];
+    weight_load_profile();
+    snprintf(path, sizeof(path), "%s/%s", CGROUP_ROOT, LOTTERY_NAME);
+    if (focus_ensure_dir(path) < 0)
+        return -1;
+    snprintf(path, sizeof(path), "%s/%s/cgroup.subtree_control", CGROUP_ROOT, LOTTERY_NAME);
+    return focus_write_file(path, "+cpu");
+}
+
+static int weight_place(pid_t pid, int tier)
+{
+    char dir[256];
+    char path[300];
+    snprintf(dir, sizeof(dir), "%s/%s/p%d", CGROUP_ROOT, LOTTERY_NAME, pid);
+
+    // first placement: create the persistent group and migrate once
+    if (access(dir, F_OK) != 0)
+    {
+        char buf[32];
+        if (focus_ensure_dir(dir) < 0)
+            return -1;
+        snprintf(path, sizeof(path), "%s/cgroup.procs", dir);
+        snprintf(buf, sizeof(buf), "%d", pid);
+        if (focus_write_file(path, buf) < 0)
+        {
+            rmdir(dir);
+            return -1;
+        }
+    }
+
+    char value[32];
+    snprintf(path, sizeof(path), "%s/cpu.weight", dir);
+    snprintf(value, sizeof(value), "%d", tiers[tier].weight);
+    return focus_write_file(path, value);
+}
+
+static int weight_release(pid_t pid)
+{
+    char path[256];
+    char buf[32];
+    snprintf(path, sizeof(path), "%s/cgroup.procs", CGROUP_ROOT);
+    snprintf(buf, sizeof(buf), "%d", pid);
+    focus_write_file(path, buf);
+
+    snprintf(path, sizeof(path), "%s/%s/p%d", CGROUP_ROOT, LOTTERY_NAME, pid);
+    return rmdir(path);
+}
+
+// Applies fn to every thread of pid; nice and policy are per-thread.
+static int for_each_thread(pid_t pid, int (*fn)(pid_t tid, int arg), int arg)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+    DIR *d = opendir(path);
+    if (!d)
+        return -1;
+
+    int done = 0;
+    int failed = 0;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL)
+    {
+        if (!isdigit((unsigned char)ent->d_name[0]))
+            continue;
+        if (fn((pid_t)atoi(ent->d_name), arg) == 0)
+            done++;
+        else if (errno != ESRCH) // a thread exiting mid-walk needs nothing
+            failed++;
+    }
+    closedir(d);
+    return (done > 0 && failed == 0) ? 0 : -1;
+}
+
+static int set_thread_nice(pid_t tid, int nice)
+{
+    return setpriority(PRIO_PROCESS, (id_t)tid, nice);
+}
+
+static int nice_place(pid_t pid, int tier)
+{
+    int nice = NICE_FOCUS + (NICE_BACKGROUND - NICE_FOCUS) * tier / bg_tier();
+    return for_each_thread(pid, set_thread_nice, nice);
+}
+
+static int nice_release(pid_t pid)
+{
+    return for_each_thread(pid, set_thread_nice, NICE_FOCUS);
+}
+
+static int set_thread_policy(pid_t tid, int policy)
+{
+    struct sched_attr_compat attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.sched_policy = (uint32_t)policy;
+    return (int)syscall(SYS_sched_setattr, tid, &attr, 0);
+}
+
+static int sched_place(pid_t pid, int tier)
+{
+    int policy = SCHED_BATCH;
+    if (tier == PLACE_FOCUS)
+        policy = SCHED_OTHER;
+    else if (tier == bg_tier())
+        policy = sched_bg_policy;
+    return for_each_thread(pid, set_thread_policy, policy);
+}
+
+static int sched_release(pid_t pid)
+{
+    return for_each_thread(pid, set_thread_policy, SCHED_OTHER);
+}
+
+static const struct actuator actuators[] = {
+    {"migrate", 1, NULL, migrate_place, migrate_release},
+    {"weight", 1, weight_init, weight_place, weight_release},
+    {"nice", 0, NULL, nice_place, nice_release},
+    {"sched-idle", 0, NULL, sched_place, sched_release},
+    {"sched-batch", 0, NULL, sched_place, sched_release},
+};
+
+static const struct actuator *find_actuator(const char *name)
+{
+    for (size_t i = 0; i < sizeof(actuators) / sizeof(actuators[0]); i++)
+    {
+        if (strcmp(actuators[i].name, name) == 0)
+            return &actuators[i];
+    }
+    return NULL;
+}
+
+/*
+ * Last placement of every managed pid, open addressing on pid.  seen is
+ * the tick that last listed the pid so departed pids can be released.
+ */
+struct placement_slot
+{
+    pid_t pid;
+    int state;
+    unsigned long seen;
+};
+
+struct placement_map
+{
+    struct placement_slot *slots;
+    int cap;
+    int used;
+};
+
+struct act_stats
+{
+    unsigned long calls;
+    unsigned long failures;
+    double sum_us;
+    double max_us;
+};
+
+static struct placement_slot *placement_get(struct placement_map *m, pid_t pid, int create)
+{
+    if (create && (m->used + 1) * 2 > m->cap)
+    {
+        int cap = m->cap ? m->cap * 2 : 64;
+        struct placement_slot *slots =
+            (struct placement_slot *)calloc((size_t)cap, sizeof(struct placement_slot));
+        if (!slots)
+            return NULL;
+        struct placement_slot *old = m->slots;
+        int old_cap = m->cap;
+        m->slots = slots;
+        m->cap = cap;
+        m->used = 0;
+        for (int i = 0; i < old_cap; i++)
+        {
+            if (old[i].pid > 0)
+                *placement_get(m, old[i].pid, 1) = old[i];
+        }
+        free(old);
+    }
+    if (m->cap == 0)
+        return NULL;
+
+    unsigned int mask = (unsigned int)m->cap - 1;
+    for (unsigned int h = ((unsigned int)pid * 2654435761u) & mask;; h = (h + 1) & mask)
+    {
+        if (m->slots[h].pid == pid)
+            return &m->slots[h];
+        if (m->slots[h].pid == 0)
+        {
+            if (!create)
+                return NULL;
+            m->slots[h].pid = pid;
+            m->slots[h].state = -1;
+            m->used++;
+            return &m->slots[h];
+        }
+    }
+}
+
+// Drops every pid not seen in tick, calling release for each one.
+static void placement_sweep(struct placement_map *m, const struct actuator *act,
+                            unsigned long tick)
+{
+    int stale = 0;
+    for (int i = 0; i < m->cap; i++)
+    {
+        if (m->slots[i].pid > 0 && m->slots[i].seen != tick)
+        {
+            if (m->slots[i].state >= 0)
+                act->release(m->slots[i].pid);
+            stale++;
+        }
+    }
+    if (stale == 0)
+        return;
+
+    struct placement_slot *old = m->slots;
+    int old_cap = m->cap;
+    m->slots = (struct placement_slot *)calloc((size_t)old_cap, sizeof(struct placement_slot));
+    if (!m->slots)
+    {
+        m->slots = old;
+        return;
+    }
+    m->used = 0;
+    for (int i = 0; i < old_cap; i++)
+    {
+        if (old[i].pid > 0 && old[i].seen == tick)
+            *placement_get(m, old[i].pid, 1) = old[i];
+    }
+    free(old);
+}
+
+/*
+ * Places pid through the backend if its placement changed, timing the
+ * call.  Returns -ESRCH when pid has exited, since retrying it would fail
+ * every tick; the backends report that as ESRCH or as a missing /proc
+ * entry, so liveness is checked directly.
+ */
+static int actuate(const struct actuator *act, struct placement_map *m, struct act_stats *st,
+                   pid_t pid, int tier, unsigned long tick)
+{
+    struct placement_slot *slot = placement_get(m, pid, 1);
+    if (!slot)
+        return 0;
+    slot->seen = tick;
+    if (slot->state == tier)
+        return 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int rc = act->place(pid, tier);
+    int err = errno;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double us = timespec_diff_sec(&end, &start) * 1e6;
+    st->calls++;
+    st->sum_us += us;
+    if (us > st->max_us)
+        st->max_us = us;
+    if (rc < 0)
+    {
+        st->failures++;
+        slot->state = -1; // retry next tick
+        if (err == ESRCH || (kill(pid, 0) < 0 && errno == ESRCH))
+            return -ESRCH;
+        return -1;
+    }
+    slot->state = tier;
+    return 0;
+}
+
+// Forgets every placement so the next tick writes them all again.
+static void placement_invalidate(struct placement_map *m)
+{
+    for (int i = 0; i < m->cap; i++)
+    {
+        if (m->slots[i].pid > 0 && m->slots[i].state != PLACE_FROZEN)
+            m->slots[i].state = -1;
+    }
+}
+
+static void placement_mark(struct placement_map *m, pid_t pid, int state, unsigned long tick)
+{
+    struct placement_slot *slot = placement_get(m, pid, 1);
+    if (slot)
+    {
+        slot->state = state;
+        slot->seen = tick;
+    }
+}
+
+static void print_act_stats(const struct actuator *act, const struct act_stats *st)
+{
+    printf("focusd: backend %s placements=%lu failures=%lu avg=%.1fus max=%.1fus\n",
+           act->name, st->calls, st->failures, st->calls ? st->sum_us / st->calls : 0.0,
+           st->max_us);
+    fflush(stdout);
+}
+
+/*
+ * Startup reconciliation.  After a restart or crash focusd does not know
+ * where its pids are, so it reads the group memberships once and seeds
+ * the placement map with them; the first tick then only moves pids whose
+ * placement differs.  Group members that are no longer registered in the
+ * ticket state may have been placed by hand (focusctl focus), so they are
+ * only moved back to the root cgroup with --release-orphans; lottery/p<pid>
+ * groups are focusd's own and always released.  Freezer state left behind
+ * by a crashed --freeze run is undone.
+ */
+
+static int cmp_pid_t(const void *a, const void *b)
+{
+    pid_t x = *(const pid_t *)a;
+    pid_t y = *(const pid_t *)b;
+    return x < y ? -1 : (x > y);
+}
+
+static int pid_listed(const pid_t *sorted, int count, pid_t pid)
+{
+    return bsearch(&pid, sorted, (size_t)count, sizeof(pid_t), cmp_pid_t) != NULL;
+}
+
+// Thaws background and empties leftover background/f<pid> children.
+static void reconcile_freezer(void)
+{
+    char dir[256];
+    char path[600];
+    struct lat_stats unused;
+    memset(&unused, 0, sizeof(unused));
+
+    snprintf(dir, sizeof(dir), "%s/%s", CGROUP_ROOT, BG_NAME);
+    snprintf(path, sizeof(path), "%s/cgroup.freeze", dir);
+    FILE *f = fopen(path, "r");
+    if (f)
+    {
+        if (fgetc(f) == '1')
+            set_frozen(dir, 0, &unused);
+        fclose(f);
+    }
+
+    DIR *d = opendir(dir);
+    if (!d)
+        return;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL)
+    {
+        char *end;
+        if (de->d_name[0] != 'f' || strtol(de->d_name + 1, &end, 10) <= 0 || *end != '\0')
+            continue;
+
+        char child[600];
+        snprintf(child, sizeof(child), "%s/%s", dir, de->d_name);
+        set_frozen(child, 0, &unused);
+
+        pid_t *members = NULL;
+        int n = 0;
+        snprintf(path, sizeof(path), "%s/%s", BG_NAME, de->d_name);
+        if (focus_group_members(path, &members, &n) == 0)
+        {
+            for (int i = 0; i < n; i++)
+                focus_move_pid(BG_NAME, members[i]);
+        }
+        free(members);
+        rmdir(child);
+    }
+    closedir(d);
+}
+
+static int reconcile_group(const char *group, int state, const pid_t *registered, int nreg,
+                           struct placement_map *placed, struct focus_txn *orphans,
+                           int *seeded, int *norphans)
+{
+    pid_t *members = NULL;
+    int n = 0;
+    if (focus_group_members(group, &members, &n) < 0)
+        return -1;
+
+    for (int i = 0; i < n; i++)
+    {
+        if (pid_listed(registered, nreg, members[i]))
+        {
+            placement_mark(placed, members[i], state, 0);
+            (*seeded)++;
+        }
+        else if (orphans)
+        {
+            focus_txn_place(orphans, members[i], NULL);
+            (*norphans)++;
+        }
+    }
+    free(members);
+    return 0;
+}
+
+// Seeds lottery/p<pid> placements from their cpu.weight; removes orphans.
+static void reconcile_weight(const pid_t *registered, int nreg, struct placement_map *placed,
+                             int *seeded, int *norphans)
+{
+    char dir[256];
+    snprintf(dir, sizeof(dir), "%s/%s", CGROUP_ROOT, LOTTERY_NAME);
+    DIR *d = opendir(dir);
+    if (!d)
+        return;
+
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL)
+    {
+        char *end;
+        pid_t pid = (pid_t)strtol(de->d_name + 1, &end, 10);
+        if (de->d_name[0] != 'p' || pid <= 0 || *end != '\0')
+            continue;
+
+        if (!pid_listed(registered, nreg, pid))
+        {
+            weight_release(pid);
+            (*norphans)++;
+            continue;
+        }
+
+        char path[600];
+        char buf[32] = "";
+        snprintf(path, sizeof(path), "%s/%s/cpu.weight", dir, de->d_name);
+        FILE *f = fopen(path, "r");
+        if (f)
+        {
+            if (!fgets(buf, sizeof(buf), f))
+                buf[0] = '\0';
+            fclose(f);
+        }
+        int weight = atoi(buf);
+        for (int t = 0; t < ntiers; t++)
+        {
+            if (tiers[t].weight == weight)
+            {
+                placement_mark(placed, pid, t, 0);
+                (*seeded)++;
+                break;
+            }
+        }
+    }
+    closedir(d);
+}
+
+static void reconcile_startup(const struct actuator *act, struct placement_map *placed,
+                              int release_orphans)
+{
+    if (!act->cgroups)
+        return;
+
+    struct ticket_entry *arr = NULL;
+    int count = 0;
+    if (focus_load_tickets(&arr, &count) < 0)
+        return;
+    pid_t *registered = (pid_t *)malloc(sizeof(pid_t) * (count > 0 ? count : 1));
+    if (!registered)
+    {
+        free(arr);
+        return;
+    }
+    for (int i = 0; i < count; i++)
+        registered[i] = arr[i].pid;
+    free(arr);
+    qsort(registered, (size_t)count, sizeof(pid_t), cmp_pid_t);
+
+    int seeded = 0;
+    int norphans = 0;
+    if (act->place == migrate_place)
+    {
+        reconcile_freezer();
+        struct focus_txn *orphans = release_orphans ? focus_txn_begin() : NULL;
+        for (int t = 0; t < ntiers; t++)
+            reconcile_group(tiers[t].name, t, registered, count, placed, orphans, &seeded,
+                            &norphans);
+        if (orphans && focus_txn_commit(orphans) < 0)
+            fprintf(stderr, "focusd: some orphaned pids could not be moved to the root cgroup\n");
+    }
+    else if (act->place == weight_place)
+    {
+        reconcile_weight(registered, count, placed, &seeded, &norphans);
+    }
+    free(registered);
+
+    printf("focusd: reconciled %d of %d registered pids with existing placement", seeded, count);
+    if (norphans > 0 || release_orphans)
+        printf(", released %d orphans.\n", norphans);
+    else
+        printf(", unregistered members kept.\n");
+}
+
+/*
+ * Interactivity-aware tickets (--auto-tickets MIN:MAX).
+ *
+ * For every managed pid /proc/<pid>/stat and /proc/<pid>/schedstat are
+ * kept open and re-read with pread() each tick.  From the deltas of CPU
+ * time, run-queue wait and wall time a smoothed sleep ratio is kept;
+ * pids that mostly sleep and run in short bursts (editors, shells,
+ * language servers) are classed interactive and get AUTO_BOOST times
+ * their tickets, clamped to the user's bounds.
+ */
+
+#define AUTO_BOOST 4
+#define AUTO_ENTER_SLEEP 0.75
+#define AUTO_LEAVE_SLEEP 0.50
+#define AUTO_MAX_BURST_NS 5000000ULL
+#define AUTO_EWMA 0.3
+
+struct interact_slot
+{
+    pid_t pid;
+    int stat_fd;
+    int schedstat_fd;
+    int interactive;
+    int primed;
+    unsigned long seen;
+    unsigned long long cpu_ns;
+    unsigned long long run_ns;
+    unsigned long long wait_ns;
+    unsigned long long slices;
+    struct timespec ts;
+    double sleep_ratio;
+};
+
+struct interact_map
+{
+    struct interact_slot *slots;
+    int cap;
+    int used;
+    int min_tickets;
+    int max_tickets;
+};
+
+static long long ns_per_tick;
+
+static int open_proc_fd(pid_t pid, const char *name)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/%s", pid, name);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+// utime+stime of the whole process, in ns.
+static int read_stat_cpu(int fd, unsigned long long *cpu_ns)
+{
+    char buf[1024];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0)
+        return -1;
+    buf[n] = '\0';
+
+    char *p = strrchr(buf, ')');
+    if (!p)
+        return -1;
+    p += 2; // field 3
+    for (int field = 3; field < 14; field++)
+    {
+        p = strchr(p, ' ');
+        if (!p)
+            return -1;
+        p++;
+    }
+    char *end;
+    unsigned long long utime = strtoull(p, &end, 10);
+    unsigned long long stime = strtoull(end, NULL, 10);
+    *cpu_ns = (utime + stime) * (unsigned long long)ns_per_tick;
+    return 0;
+}
+
+// schedstat: ns on cpu, ns waiting on a run queue, timeslices run.
+static int read_schedstat(int fd, unsigned long long *run, unsigned long long *wait,
+                          unsigned long long *slices)
+{
+    char buf[128];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0)
+        return -1;
+    buf[n] = '\0';
+    return sscanf(buf, "%llu %llu %llu", run, wait, slices) == 3 ? 0 : -1;
+}
+
+static void interact_close(struct interact_slot *s)
+{
+    if (s->stat_fd >= 0)
+        close(s->stat_fd);
+    if (s->schedstat_fd >= 0)
+        close(s->schedstat_fd);
+}
+
+/*
+ * Moves the slots into a table of cap slots, keeping their open fds.
+ * With evict set, slots not seen at *evict are closed and dropped.
+ */
+static int interact_rehash(struct interact_map *m, int cap, const unsigned long *evict)
+{
+    struct interact_slot *slots =
+        (struct interact_slot *)calloc((size_t)cap, sizeof(struct interact_slot));
+    if (!slots)
+        return -1;
+    struct interact_slot *old = m->slots;
+    int old_cap = m->cap;
+    m->slots = slots;
+    m->cap = cap;
+    m->used = 0;
+    for (int i = 0; i < old_cap; i++)
+    {
+        if (old[i].pid <= 0)
+            continue;
+        if (evict && old[i].seen != *evict)
+        {
+            interact_close(&old[i]);
+            continue;
+        }
+        unsigned int mask = (unsigned int)cap - 1;
+        unsigned int h = ((unsigned int)old[i].pid * 2654435761u) & mask;
+        while (slots[h].pid != 0)
+            h = (h + 1) & mask;
+        slots[h] = old[i];
+        m->used++;
+    }
+    free(old);
+    return 0;
+}
+
+static struct interact_slot *interact_get(struct interact_map *m, pid_t pid)
+{
+    if ((m->used + 1) * 2 > m->cap && interact_rehash(m, m->cap ? m->cap * 2 : 64, NULL) < 0)
+        return NULL;
+
+    unsigned int mask = (unsigned int)m->cap - 1;
+    for (unsigned int h = ((unsigned int)pid * 2654435761u) & mask;; h = (h + 1) & mask)
+    {
+        struct interact_slot *s = &m->slots[h];
+        if (s->pid == pid)
+            return s;
+        if (s->pid == 0)
+        {
+            memset(s, 0, sizeof(*s));
+            s->pid = pid;
+            s->stat_fd = open_proc_fd(pid, "stat");
+            s->schedstat_fd = open_proc_fd(pid, "schedstat");
+            m->used++;
+            return s;
+        }
+    }
+}
+
+// Closes and forgets pids that were not listed in tick.
+static void interact_sweep(struct interact_map *m, unsigned long tick)
+{
+    int stale = 0;
+    for (int i = 0; i < m->cap; i++)
+    {
+        if (m->slots[i].pid > 0 && m->slots[i].seen != tick)
+            stale++;
+    }
+    if (stale == 0)
+        return;
+
+    // survivors keep their fds; on failure the next sweep tries again
+    interact_rehash(m, m->cap, &tick);
+}
+
+static void interact_sample(struct interact_slot *s)
+{
+    unsigned long long cpu, run, wait, slices;
+    struct timespec now;
+
+    if (s->stat_fd < 0 || s->schedstat_fd < 0)
+        return;
+    if (read_stat_cpu(s->stat_fd, &cpu) < 0 || read_schedstat(s->schedstat_fd, &run, &wait, &slices) < 0)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (s->primed)
+    {
+        double wall = timespec_diff_sec(&now, &s->ts) * 1e9;
+        unsigned long long d_run = run - s->run_ns;
+        unsigned long long d_cpu = cpu - s->cpu_ns;
+        unsigned long long d_slices = slices - s->slices;
+        // schedstat covers the main thread, stat the whole process
+        double busy = (double)(d_cpu > d_run ? d_cpu : d_run) + (double)(wait - s->wait_ns);
+
+        if (wall > 0.0)
+        {
+            double sleep = 1.0 - busy / wall;
+            if (sleep < 0.0)
+                sleep = 0.0;
+            s->sleep_ratio = (1.0 - AUTO_EWMA) * s->sleep_ratio + AUTO_EWMA * sleep;
+        }
+
+        unsigned long long burst = d_slices ? d_run / d_slices : 0;
+        if (!s->interactive && s->sleep_ratio >= AUTO_ENTER_SLEEP && burst <= AUTO_MAX_BURST_NS)
+            s->interactive = 1;
+        else if (s->interactive && s->sleep_ratio < AUTO_LEAVE_SLEEP)
+            s->interactive = 0;
+    }
+    else
+    {
+        s->sleep_ratio = 0.0;
+        s->primed = 1;
+    }
+
+    s->cpu_ns = cpu;
+    s->run_ns = run;
+    s->wait_ns = wait;
+    s->slices = slices;
+    s->ts = now;
+}
+
+// Rewrites arr[].tickets with the effective tickets of this tick.
+static void interact_adjust(struct interact_map *m, struct ticket_entry *arr, int count,
+                            unsigned long tick)
+{
+    for (int i = 0; i < count; i++)
+    {
+        struct interact_slot *s = interact_get(m, arr[i].pid);
+        if (!s)
+            continue;
+        s->seen = tick;
+
+        int was = s->interactive;
+        interact_sample(s);
+
+        long eff = s->interactive ? (long)arr[i].tickets * AUTO_BOOST : arr[i].tickets;
+        if (eff < m->min_tickets)
+            eff = m->min_tickets;
+        if (eff > m->max_tickets)
+            eff = m->max_tickets;
+
+        if (was != s->interactive)
+        {
+            printf("focusd: pid %d is now %s (sleeping %.0f%%), tickets %d -> %ld\n", arr[i].pid,
+                   s->interactive ? "interactive" : "batch", 100.0 * s->sleep_ratio,
+                   arr[i].tickets, eff);
+        }
+        arr[i].tickets = (int)eff;
+    }
+    interact_sweep(m, tick);
+}
+
+/*
+ * Run-queue latency SLO (--slo-p99 MS).
+ *
+ * A pid's scheduling delay is taken from the run-queue wait field of
+ * /proc/<pid>/schedstat over the slices it spent in focus: the winners of
+ * a tick are primed when placed and sampled at the next tick, each sample
+ * being the wait per timeslice over that interval.  Samples go into a
+ * per-pid window; every SLO_ADJUST_TICKS the worst p99 over the focused
+ * pids is compared with the target.  Above it, background is squeezed one
+ * step at a time: cpu.weight is halved down to 1, then cpu.max is halved
+ * down to SLO_MIN_QUOTA_PCT of a CPU, then the winner count is lowered.
+ * Well below it the same steps are undone in reverse.
+ */
+
+#define SLO_WINDOW 128
+#define SLO_MIN_SAMPLES 16
+#define SLO_ADJUST_TICKS 20
+#define SLO_MIN_QUOTA_PCT 5
+
+struct slo_slot
 {
     pid_t pid;
-    int tickets;
+    int fd;
+    int primed;
+    unsigned long seen;
+    unsigned long long wait_ns;
+    unsigned long long slices;
+    double samples[SLO_WINDOW]; // ms
+    int nsamples;
+    int next;
+};
+
+struct slo_state
+{
+    double target_ms;
+    struct slo_slot *slots;
+    int cap;
+    int used;
+    unsigned long last_adjust;
+    int base_weight; // background cpu.weight from the profile
+    int weight;
+    long long base_quota; // background cpu.max quota from the profile, 0 = "max"
+    long long quota;
+    int max_winners;
+    int winners;
+};
+
+static struct slo_slot *slo_get(struct slo_state *s, pid_t pid)
+{
+    if ((s->used + 1) * 2 > s->cap)
+    {
+        int cap = s->cap ? s->cap * 2 : 64;
+        struct slo_slot *slots = (struct slo_slot *)calloc((size_t)cap, sizeof(struct slo_slot));
+        if (!slots)
+            return NULL;
+        struct slo_slot *old = s->slots;
+        int old_cap = s->cap;
+        s->slots = slots;
+        s->cap = cap;
+        s->used = 0;
+        for (int i = 0; i < old_cap; i++)
+        {
+            if (old[i].pid <= 0)
+                continue;
+            unsigned int mask = (unsigned int)cap - 1;
+            unsigned int h = ((unsigned int)old[i].pid * 2654435761u) & mask;
+            while (slots[h].pid != 0)
+                h = (h + 1) & mask;
+            slots[h] = old[i];
+            s->used++;
+        }
+        free(old);
+    }
+
+    unsigned int mask = (unsigned int)s->cap - 1;
+    for (unsigned int h = ((unsigned int)pid * 2654435761u) & mask;; h = (h + 1) & mask)
+    {
+        struct slo_slot *slot = &s->slots[h];
+        if (slot->pid == pid)
+            return slot;
+        if (slot->pid == 0)
+        {
+            memset(slot, 0, sizeof(*slot));
+            slot->pid = pid;
+            slot->fd = open_proc_fd(pid, "schedstat");
+            s->used++;
+            return slot;
+        }
+    }
+}
+
+// Closes and forgets pids that were not listed in tick.
+static void slo_sweep(struct slo_state *s, unsigned long tick)
+{
+    int stale = 0;
+    for (int i = 0; i < s->cap; i++)
+    {
+        if (s->slots[i].pid > 0 && s->slots[i].seen != tick)
+            stale++;
+    }
+    if (stale == 0)
+        return;
+
+    struct slo_slot *old = s->slots;
+    int old_cap = s->cap;
+    s->slots = (struct slo_slot *)calloc((size_t)old_cap, sizeof(struct slo_slot));
+    if (!s->slots)
+    {
+        s->slots = old;
+        return;
+    }
+    s->used = 0;
+    unsigned int mask = (unsigned int)old_cap - 1;
+    for (int i = 0; i < old_cap; i++)
+    {
+        if (old[i].pid <= 0)
+            continue;
+        if (old[i].seen != tick)
+        {
+            if (old[i].fd >= 0)
+                close(old[i].fd);
+            continue;
+        }
+        unsigned int h = ((unsigned int)old[i].pid * 2654435761u) & mask;
+        while (s->slots[h].pid != 0)
+            h = (h + 1) & mask;
+        s->slots[h] = old[i];
+        s->used++;
+    }
+    free(old);
+}
+
+// Records the delay of the slice a primed pid just spent in focus.
+static void slo_sample(struct slo_slot *slot)
+{
+    unsigned long long run, wait, slices;
+    if (slot->fd < 0 || read_schedstat(slot->fd, &run, &wait, &slices) < 0)
+    {
+        slot->primed = 0;
+        return;
+    }
+
+    if (slot->primed)
+    {
+        unsigned long long d_wait = wait - slot->wait_ns;
+        unsigned long long d_slices = slices - slot->slices;
+        // runnable but never ran counts its whole wait as one delay
+        if (d_wait > 0 || d_slices > 0)
+        {
+            double ms = (double)d_wait / (double)(d_slices ? d_slices : 1) / 1e6;
+            slot->samples[slot->next] = ms;
+            slot->next = (slot->next + 1) % SLO_WINDOW;
+            if (slot->nsamples < SLO_WINDOW)
+                slot->nsamples++;
+        }
+    }
+    slot->primed = 0;
+}
+
+static void slo_prime(struct slo_slot *slot)
+{
+    unsigned long long run;
+    if (slot->fd >= 0 && read_schedstat(slot->fd, &run, &slot->wait_ns, &slot->slices) == 0)
+        slot->primed = 1;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : (x > y);
+}
+
+static double slo_p99(const struct slo_slot *slot)
+{
+    double sorted[SLO_WINDOW];
+    memcpy(sorted, slot->samples, sizeof(double) * slot->nsamples);
+    qsort(sorted, (size_t)slot->nsamples, sizeof(double), cmp_double);
+    int idx = (slot->nsamples * 99 + 99) / 100 - 1;
+    return sorted[idx];
+}
+
+static int read_bg_weight(void)
+{
+    char path[256];
+    char buf[32] = "";
+    snprintf(path, sizeof(path), "%s/%s/cpu.weight", CGROUP_ROOT, BG_NAME);
+    FILE *f = fopen(path, "r");
+    if (f)
+    {
+        if (!fgets(buf, sizeof(buf), f))
+            buf[0] = '\0';
+        fclose(f);
+    }
+    int weight = atoi(buf);
+    return weight > 0 ? weight : 100;
+}
+
+// Background quota scaled to CAP_PERIOD_US, 0 when uncapped.
+static long long read_bg_quota(void)
+{
+    char path[256];
+    char buf[64] = "";
+    long long quota = 0, period = 0;
+    snprintf(path, sizeof(path), "%s/%s/cpu.max", CGROUP_ROOT, BG_NAME);
+    FILE *f = fopen(path, "r");
+    if (f)
+    {
+        if (!fgets(buf, sizeof(buf), f))
+            buf[0] = '\0';
+        fclose(f);
+    }
+    if (sscanf(buf, "%lld %lld", &quota, &period) != 2 || quota <= 0 || period <= 0)
+        return 0;
+    quota = quota * CAP_PERIOD_US / period;
+    return quota > 0 ? quota : 1;
+}
+
+static void slo_reset(struct slo_state *s)
+{
+    s->base_weight = read_bg_weight();
+    s->weight = s->base_weight;
+    s->base_quota = read_bg_quota();
+    s->quota = s->base_quota;
+    s->winners = s->max_winners;
+}
+
+static void slo_write_weight(struct slo_state *s, int weight)
+{
+    char path[256];
+    char value[32];
+    snprintf(path, sizeof(path), "%s/%s/cpu.weight", CGROUP_ROOT, BG_NAME);
+    snprintf(value, sizeof(value), "%d", weight);
+    if (focus_write_file(path, value) == 0)
+        s->weight = weight;
+}
+
+static void slo_write_quota(struct slo_state *s, long long quota)
+{
+    char path[256];
+    char value[64];
+    snprintf(path, sizeof(path), "%s/%s/cpu.max", CGROUP_ROOT, BG_NAME);
+    if (quota == 0)
+        snprintf(value, sizeof(value), "max %d", CAP_PERIOD_US);
+    else
+        snprintf(value, sizeof(value), "%lld %d", quota, CAP_PERIOD_US);
+    if (focus_write_file(path, value) == 0)
+        s->quota = quota;
+}
+
+static void slo_format_quota(long long quota, char *out, size_t size)
+{
+    if (quota == 0)
+        snprintf(out, size, "max");
+    else
+        snprintf(out, size, "%lld", quota);
+}
+
+static void slo_log(const struct slo_state *s, int tighten, double p99, const char *fmt, ...)
+{
+    va_list ap;
+    printf("focusd: slo p99 %.2f ms %s %.2f ms: ", p99, tighten ? ">" : "<", s->target_ms);
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    putchar('\n');
+}
+
+// One step towards (tighten) or away from (relax) starving background.
+static void slo_step(struct slo_state *s, int tighten, double p99)
+{
+    long long full = sysconf(_SC_NPROCESSORS_ONLN) * (long long)CAP_PERIOD_US;
+    long long floor = (long long)SLO_MIN_QUOTA_PCT * CAP_PERIOD_US / 100;
+    long long cur = s->quota ? s->quota : full;
+    char from[32], to[32];
+
+    if (tighten && s->weight > 1)
+    {
+        int weight = s->weight / 2 > 1 ? s->weight / 2 : 1;
+        slo_log(s, tighten, p99, "background cpu.weight %d -> %d", s->weight, weight);
+        slo_write_weight(s, weight);
+    }
+    else if (tighten && cur > floor)
+    {
+        long long quota = cur / 2 > floor ? cur / 2 : floor;
+        slo_format_quota(s->quota, from, sizeof(from));
+        slo_format_quota(quota, to, sizeof(to));
+        slo_log(s, tighten, p99, "background cpu.max %s -> %s", from, to);
+        slo_write_quota(s, quota);
+    }
+    else if (tighten && s->winners > 1)
+    {
+        slo_log(s, tighten, p99, "winners %d -> %d", s->winners, s->winners - 1);
+        s->winners--;
+    }
+    else if (!tighten && s->winners < s->max_winners)
+    {
+        slo_log(s, tighten, p99, "winners %d -> %d", s->winners, s->winners + 1);
+        s->winners++;
+    }
+    else if (!tighten && s->quota != s->base_quota)
+    {
+        long long quota = s->quota * 2;
+        if (s->base_quota ? quota >= s->base_quota : quota >= full)
+            quota = s->base_quota;
+        slo_format_quota(s->quota, from, sizeof(from));
+        slo_format_quota(quota, to, sizeof(to));
+        slo_log(s, tighten, p99, "background cpu.max %s -> %s", from, to);
+        slo_write_quota(s, quota);
+    }
+    else if (!tighten && s->weight < s->base_weight)
+    {
+        int weight = s->weight * 2 < s->base_weight ? s->weight * 2 : s->base_weight;
+        slo_log(s, tighten, p99, "background cpu.weight %d -> %d", s->weight, weight);
+        slo_write_weight(s, weight);
+    }
+}
+
+// Samples last tick's winners; called before the new draw.
+static void slo_begin_tick(struct slo_state *s, unsigned long tick)
+{
+    for (int i = 0; i < s->cap; i++)
+    {
+        if (s->slots[i].pid > 0 && s->slots[i].primed)
+            slo_sample(&s->slots[i]);
+    }
+    if (tick - s->last_adjust < SLO_ADJUST_TICKS)
+        return;
+
+    double worst = -1.0;
+    for (int i = 0; i < s->cap; i++)
+    {
+        if (s->slots[i].pid > 0 && s->slots[i].nsamples >= SLO_MIN_SAMPLES)
+        {
+            double p99 = slo_p99(&s->slots[i]);
+            if (p99 > worst)
+                worst = p99;
+        }
+    }
+    if (worst < 0.0)
+        return;
+
+    int tighten = worst > s->target_ms;
+    int relax = worst < s->target_ms / 2;
+    int at_baseline = s->winners == s->max_winners && s->quota == s->base_quota &&
+                      s->weight >= s->base_weight;
+    if (tighten || (relax && !at_baseline))
+    {
+        slo_step(s, tighten, worst);
+        // judge the new setting on fresh samples only
+        for (int i = 0; i < s->cap; i++)
+            s->slots[i].nsamples = s->slots[i].next = 0;
+    }
+    s->last_adjust = tick;
+}
+
+// Primes this tick's winners and forgets pids that left the lottery.
+static void slo_end_tick(struct slo_state *s, const struct ticket_entry *arr,
+                         const unsigned char *tier_of, int count, unsigned long tick)
+{
+    for (int i = 0; i < count; i++)
+    {
+        struct slo_slot *slot = slo_get(s, arr[i].pid);
+        if (!slot)
+            continue;
+        slot->seen = tick;
+        if (tier_of[i] == PLACE_FOCUS)
+            slo_prime(slot);
+    }
+    slo_sweep(s, tick);
+}
+
+/*
+ * Placement rules (RULES_FILE).  focusd evaluates the compiled rules over
+ * a full /proc scan at start, whenever the file changes and every
+ * RULES_RESCAN_SEC, and for single processes as the kernel's proc
+ * connector reports execs.  A scan only evaluates processes it has not
+ * seen before (new pid or starttime, or exec'd since), so steady-state
+ * rescans cost one stat read per process.  Without the connector (it
+ * needs CAP_NET_ADMIN) rescans are the only way to see new processes and
+ * run more often.
+ *
+ * The connector also reports exits, with or without rules: registered
+ * pids that exit are removed from the ticket state so they stop holding
+ * tickets and a recycled pid does not inherit them.
+ */
+
+#define RULES_RESCAN_SEC 10
+#define RULES_RESCAN_EVENTS_SEC 60
+
+struct rule_engine
+{
+    struct focus_rules *rules;
+    struct focus_proc_cache cache;
+    struct timespec mtime;
+    int events_fd; // proc connector socket, -1 = rescans only
+    int cgroups;   // whether group placements can be applied
+    int rescan_all;
+    time_t last_scan;
+    struct focus_txn *txn;
+    unsigned long applied;
+    pid_t *exited; // processes that exited since the last reap
+    int nexited;
+    int exited_cap;
 };
 
-static int write_file(const char *path, const char *value)
+static int rules_rescan_sec(const struct rule_engine *e)
+{
+    return e->events_fd >= 0 ? RULES_RESCAN_EVENTS_SEC : RULES_RESCAN_SEC;
+}
+
+static int rules_active(const struct rule_engine *e)
+{
+    return e->rules && focus_rules_count(e->rules) > 0;
+}
+
+static void rules_stat(struct timespec *out)
+{
+    struct stat st;
+    if (stat(RULES_FILE, &st) == 0)
+        *out = st.st_mtim;
+    else
+        out->tv_sec = out->tv_nsec = 0;
+}
+
+static int proc_events_open(void)
+{
+    int fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (fd < 0)
+        return -1;
+
+    struct sockaddr_nl sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;
+    sa.nl_groups = CN_IDX_PROC;
+    sa.nl_pid = 0; // let the kernel pick
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    // nlmsghdr, then cn_msg carrying the listen op
+    char buf[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op))];
+    memset(buf, 0, sizeof(buf));
+    struct nlmsghdr *nl = (struct nlmsghdr *)buf;
+    struct cn_msg *cn = (struct cn_msg *)NLMSG_DATA(nl);
+    enum proc_cn_mcast_op op = PROC_CN_MCAST_LISTEN;
+    nl->nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(op));
+    nl->nlmsg_type = NLMSG_DONE;
+    nl->nlmsg_pid = (unsigned int)getpid();
+    cn->id.idx = CN_IDX_PROC;
+    cn->id.val = CN_VAL_PROC;
+    cn->len = sizeof(op);
+    memcpy(cn->data, &op, sizeof(op));
+    if (send(fd, buf, nl->nlmsg_len, 0) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Queues the placement and tickets of the rule pi matches, if any.
+static void rules_apply(struct rule_engine *e, const struct focus_proc_info *pi,
+                        const char *parent_comm)
+{
+    int idx = focus_rules_match(e->rules, pi, parent_comm);
+    if (idx < 0)
+        return;
+    const struct focus_rule *rule = focus_rules_get(e->rules, idx);
+
+    if (!e->txn)
+        e->txn = focus_txn_begin();
+    if (!e->txn)
+        return;
+    if (rule->group[0] && e->cgroups)
+        focus_txn_place(e->txn, pi->pid, rule->group);
+    if (rule->tickets > 0)
+        focus_txn_set_tickets(e->txn, pi->pid, rule->tickets);
+    e->applied++;
+}
+
+static const char *rules_parent_comm(struct rule_engine *e, pid_t ppid, struct focus_proc_info *tmp)
+{
+    const struct focus_proc_info *parent = focus_proc_cache_lookup(&e->cache, ppid);
+    if (parent)
+        return parent->comm;
+    if (ppid > 0 && focus_read_proc(ppid, 0, tmp) == 0)
+        return tmp->comm;
+    return NULL;
+}
+
+// Runs before the scan replaces e->cache, so lookups see the last scan.
+static int rules_visit(const struct focus_proc_info *pi, void *arg)
+{
+    struct rule_engine *e = (struct rule_engine *)arg;
+    const struct focus_proc_info *old = focus_proc_cache_lookup(&e->cache, pi->pid);
+    if (!e->rescan_all && old && old->starttime == pi->starttime &&
+        strcmp(old->comm, pi->comm) == 0 && old->exe_dev == pi->exe_dev &&
+        old->exe_ino == pi->exe_ino)
+        return 0;
+
+    struct focus_proc_info parent;
+    rules_apply(e, pi, rules_parent_comm(e, pi->ppid, &parent));
+    return 0;
+}
+
+static void rules_commit(struct rule_engine *e)
+{
+    if (e->txn && focus_txn_commit(e->txn) < 0)
+        fprintf(stderr, "focusd: some rule placements failed\n");
+    e->txn = NULL;
+}
+
+static void rules_scan_now(struct rule_engine *e)
+{
+    focus_scan_procs(&e->cache, focus_rules_want(e->rules), rules_visit, e);
+    rules_commit(e);
+    e->rescan_all = 0;
+    e->last_scan = time(NULL);
+}
+
+static void rules_reload(struct rule_engine *e)
+{
+    struct focus_rules *rules = focus_rules_load();
+    if (!rules)
+        return; // keep the previous rules
+    focus_rules_free(e->rules);
+    e->rules = rules;
+    e->rescan_all = 1;
+    printf("focusd: loaded %d placement rules.\n", focus_rules_count(rules));
+}
+
+static void rules_init(struct rule_engine *e, int cgroups)
+{
+    memset(e, 0, sizeof(*e));
+    e->cgroups = cgroups;
+    rules_stat(&e->mtime);
+    e->rules = focus_rules_load();
+    e->events_fd = proc_events_open();
+    e->rescan_all = 1;
+    if (rules_active(e))
+    {
+        printf("focusd: %d placement rules, %s.\n", focus_rules_count(e->rules),
+               e->events_fd >= 0 ? "evaluated on exec" : "rescanned periodically");
+        rules_scan_now(e);
+    }
+}
+
+static void rules_note_exit(struct rule_engine *e, pid_t pid)
+{
+    if (e->nexited == e->exited_cap)
+    {
+        int cap = e->exited_cap ? e->exited_cap * 2 : 64;
+        pid_t *p = (pid_t *)realloc(e->exited, sizeof(pid_t) * cap);
+        if (!p)
+            return; // the failed placement catches it instead
+        e->exited = p;
+        e->exited_cap = cap;
+    }
+    e->exited[e->nexited++] = pid;
+}
+
+// Evaluates processes that exec'd since the last call and notes exits.
+static void rules_drain_events(struct rule_engine *e)
+{
+    char buf[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+    ssize_t n;
+    while (e->events_fd >= 0 && (n = recv(e->events_fd, buf, sizeof(buf), 0)) > 0)
+    {
+        int len = (int)n;
+        for (struct nlmsghdr *nl = (struct nlmsghdr *)buf; NLMSG_OK(nl, (unsigned int)len);
+             nl = NLMSG_NEXT(nl, len))
+        {
+            struct cn_msg *cn = (struct cn_msg *)NLMSG_DATA(nl);
+            if (cn->id.idx != CN_IDX_PROC || cn->id.val != CN_VAL_PROC)
+                continue;
+            struct proc_event *ev = (struct proc_event *)cn->data;
+            // a process is gone when its thread group leader exits
+            if (ev->what == EXIT_EVENT &&
+                ev->event_data.exit.process_pid == ev->event_data.exit.process_tgid)
+                rules_note_exit(e, ev->event_data.exit.process_tgid);
+            if (ev->what != EXEC_EVENT || !rules_active(e))
+                continue;
+
+            // only the thread group leader's exec changes what we match on
+            pid_t pid = ev->event_data.exec.process_tgid;
+            struct focus_proc_info pi, parent;
+            if (focus_read_proc(pid, focus_rules_want(e->rules), &pi) == 0)
+                rules_apply(e, &pi, rules_parent_comm(e, pi.ppid, &parent));
+        }
+    }
+    rules_commit(e);
+}
+
+static void rules_tick(struct rule_engine *e)
+{
+    struct timespec mtime;
+    rules_stat(&mtime);
+    if (mtime.tv_sec != e->mtime.tv_sec || mtime.tv_nsec != e->mtime.tv_nsec)
+    {
+        e->mtime = mtime;
+        rules_reload(e);
+    }
+    rules_drain_events(e);
+    if (!rules_active(e))
+        return;
+    if (e->rescan_all || time(NULL) - e->last_scan >= rules_rescan_sec(e))
+        rules_scan_now(e);
+}
+
+/*
+ * Removes the entries of exited processes from the ticket state and from
+ * this tick's copy of it, compacting arr.  Returns the new count.
+ */
+static int rules_reap(struct rule_engine *e, struct ticket_entry *arr, int count)
+{
+    if (e->nexited == 0)
+        return count;
+    qsort(e->exited, (size_t)e->nexited, sizeof(pid_t), cmp_pid_t);
+
+    struct focus_txn *txn = NULL;
+    int kept = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (!pid_listed(e->exited, e->nexited, arr[i].pid))
+        {
+            arr[kept++] = arr[i];
+            continue;
+        }
+        if (!txn)
+            txn = focus_txn_begin();
+        if (txn)
+            focus_txn_set_tickets(txn, arr[i].pid, 0);
+    }
+    if (txn && focus_txn_commit(txn) < 0)
+        fprintf(stderr, "focusd: failed to remove exited pids\n");
+    e->nexited = 0;
+    return kept;
+}
+
+static void rules_free(struct rule_engine *e)
+{
+    free(e->exited);
+    if (e->events_fd >= 0)
+        close(e->events_fd);
+    focus_rules_free(e->rules);
+    focus_proc_cache_free(&e->cache);
+}
+
+/*
+ * Tickless idle.  Without a contest to run (no more entries than winners,
+ * all of them placed) every tick would repeat the previous outcome,
+ * so focusd blocks on an inotify watch of STATE_DIR until the ticket
+ * state or the profiles change instead of waking every timeslice.
+ */
+
+static int idle_watch_open(void)
 {
-    FILE *f = fopen(path, "w");
-    if (!f)
-    {
-        perror(path);
-        return -1;
-    }
-    if (fprintf(f, "%s\n", value) < 0)
-    {
-        perror("fprintf");
-        fclose(f);
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
         return -1;
-    }
-    if (fclose(f) != 0)
+    if (inotify_add_watch(fd, STATE_DIR, IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO |
+                                             IN_DELETE) < 0)
     {
-        perror("fclose");
+        close(fd);
         return -1;
     }
-    return 0;
+    return fd;
+}
+
+// Consumes queued events; called before the state is read so none is lost.
+static void idle_watch_drain(int fd)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (fd >= 0 && read(fd, buf, sizeof(buf)) > 0)
+        ;
 }
 
-static int ensure_dir(const char *path)
+// Whether another tick could change anything: no contest, nothing to retry.
+static int lottery_settled(const struct ticket_entry *arr, int count, int winners,
+                           struct placement_map *placed)
 {
-    if (mkdir(path, 0755) < 0)
+    if (count > winners)
+        return 0;
+    for (int i = 0; i < count; i++)
     {
-        if (errno == EEXIST)
+        const struct placement_slot *slot = placement_get(placed, arr[i].pid, 0);
+        if (!slot || slot->state < 0)
             return 0;
-        perror(path);
-        return -1;
     }
-    return 0;
+    return 1;
 }
 
-static int check_cgroup_v2(void)
+// Sleeps one timeslice, or until STATE_DIR changes when idle is set.
+// Active rules also wake an idle focusd for exec events and rescans.
+static void wait_next_tick(int watch_fd, const struct rule_engine *rules, int idle,
+                           int timeslice_ms)
 {
-    char path[256];
-    snprintf(path, sizeof(path), "%s/cgroup.controllers", CGROUP_ROOT);
-    if (access(path, F_OK) != 0)
+    if (idle && watch_fd >= 0)
     {
-        fprintf(stderr, "cgroup v2 not found at %s\n", CGROUP_ROOT);
-        return -1;
+        struct pollfd pfd[2] = {{watch_fd, POLLIN, 0}, {-1, POLLIN, 0}};
+        int timeout = -1;
+        if (rules_active(rules))
+        {
+            pfd[1].fd = rules->events_fd;
+            timeout = rules_rescan_sec(rules) * 1000;
+        }
+        poll(pfd, 2, timeout); // SIGINT/SIGTERM interrupt it
+        return;
     }
-    return 0;
+    usleep(timeslice_ms * 1000);
 }
 
-static int init_cgroups(void)
+/*
+ * Ranking into tiers.  Every entry gets an Efraimidis-Spirakis key
+ * log(u) / tickets for uniform u; the k largest keys are a weighted draw
+ * of k entries without replacement, so tier 0 is exactly the old lottery.
+ * Only the tier boundaries matter, so each tier is cut off the remaining
+ * entries with a quickselect instead of sorting all keys.
+ */
+
+struct rank_key
 {
-    char path[256];
+    double key;
+    int idx;
+};
 
-    if (check_cgroup_v2() < 0)
-    {
-        return -1;
-    }
+#define HOLD_NONE 0
+#define HOLD_FOCUS 1  // stays in focus without a draw
+#define HOLD_BARRED 2 // sits out the focus draw to repay debt
 
-    snprintf(path, sizeof(path), "%s/cgroup.subtree_control", CGROUP_ROOT);
-    FILE *sc = fopen(path, "r+");
-    if (sc)
+// Moves the k largest keys of keys[lo..hi) to keys[lo..lo+k), unordered.
+static void select_top(struct rank_key *keys, int lo, int hi, int k)
+{
+    int want = lo + k; // first position that must not hold a top key
+    while (hi - lo > 1 && want > lo && want < hi)
     {
-        char buf[256] = {0};
-        if (fgets(buf, sizeof(buf), sc))
+        int p = lo + rand() % (hi - lo);
+        struct rank_key pivot = keys[p];
+        keys[p] = keys[hi - 1];
+        keys[hi - 1] = pivot;
+
+        int store = lo;
+        for (int i = lo; i < hi - 1; i++)
         {
-            if (strstr(buf, "cpu") == NULL)
-            {
-                fclose(sc);
-                sc = fopen(path, "w");
-                if (sc)
-                {
-                    fprintf(sc, "+cpu\n");
-                    fclose(sc);
-                }
-            }
-            else
+            if (keys[i].key > pivot.key)
             {
-                fclose(sc);
+                struct rank_key tmp = keys[i];
+                keys[i] = keys[store];
+                keys[store++] = tmp;
             }
         }
+        keys[hi - 1] = keys[store];
+        keys[store] = pivot;
+
+        if (store < want - 1)
+            lo = store + 1;
+        else if (store > want - 1)
+            hi = store;
         else
+            break;
+    }
+}
+
+// Sets tier_of[i] for every entry; returns the number placed into tier 0.
+// hold[i] forces an entry into focus or keeps it out while others can
+// fill focus (see the residency section below).
+static int rank_tiers(const struct ticket_entry *arr, int count, const unsigned char *hold,
+                      struct rank_key *keys, unsigned char *tier_of)
+{
+    // entries that may be focused first, barred ones after them
+    int ranked = 0;
+    int eligible = 0;
+    for (int barred = 0; barred <= 1; barred++)
+    {
+        for (int i = 0; i < count; i++)
         {
-            fclose(sc);
+            if (barred == 0)
+                tier_of[i] = (unsigned char)bg_tier(); // no tickets, never drawn
+            if (arr[i].tickets <= 0 || (hold[i] == HOLD_BARRED) != barred)
+                continue;
+            double u = (rand() + 1.0) / ((double)RAND_MAX + 2.0); // (0, 1)
+            keys[ranked].key = hold[i] == HOLD_FOCUS ? HUGE_VAL : log(u) / arr[i].tickets;
+            keys[ranked].idx = i;
+            ranked++;
         }
+        if (barred == 0)
+            eligible = ranked;
     }
 
-    snprintf(path, sizeof(path), "%s/%s", CGROUP_ROOT, FOCUS_NAME);
-    if (ensure_dir(path) < 0)
-        return -1;
+    int pos = 0;
+    for (int t = 0; t < bg_tier() && pos < ranked; t++)
+    {
+        int n = tiers[t].size < ranked - pos ? tiers[t].size : ranked - pos;
+        if (t == PLACE_FOCUS && n > eligible)
+        {
+            // too few eligible entries: top focus up from the barred ones
+            select_top(keys, eligible, ranked, n - eligible);
+        }
+        else
+        {
+            select_top(keys, pos, t == PLACE_FOCUS ? eligible : ranked, n);
+        }
+        for (int j = pos; j < pos + n; j++)
+            tier_of[keys[j].idx] = (unsigned char)t;
+        pos += n;
+    }
+    return tiers[PLACE_FOCUS].size < ranked ? tiers[PLACE_FOCUS].size : ranked;
+}
 
-    snprintf(path, sizeof(path), "%s/%s", CGROUP_ROOT, BG_NAME);
-    if (ensure_dir(path) < 0)
-        return -1;
+/*
+ * Winner residency (--min-residency MS, --keep-prob P).  With a short
+ * timeslice focus bounces between pids every tick, and each switch costs
+ * the demoted pid its warm caches, TLB and boost clocks.  A pid drawn into
+ * focus keeps it for at least MS; after that it keeps it with probability
+ * P each tick instead of entering the draw.  Every held slice is charged
+ * as 1 - p of debt, p being the pid's fair chance of focus that tick; a
+ * pid in debt sits out the focus draw and pays back p per slice, so long
+ * run shares still follow the tickets.  Focus switches, stint length and
+ * the lottery's CPU time are reported every STATS_INTERVAL_SEC either
+ * way, so settings can be compared on the same workload.
+ */
 
-    char cpu_path[256];
-    snprintf(cpu_path, sizeof(cpu_path), "%s/%s/cpu.weight", CGROUP_ROOT, FOCUS_NAME);
-    if (write_file(cpu_path, "1000") < 0)
-        return -1;
+struct resid_slot
+{
+    pid_t pid;
+    int focused;         // in focus last tick
+    unsigned long since; // tick the current focus stint began
+    unsigned long seen;
+    double debt;               // focus slices owed to others, < 0 = owed to it
+    unsigned long long run_ns; // schedstat run time at the last report
+};
 
-    snprintf(cpu_path, sizeof(cpu_path), "%s/%s/cpu.weight", CGROUP_ROOT, BG_NAME);
-    if (write_file(cpu_path, "10") < 0)
-        return -1;
+struct resid_state
+{
+    int min_ticks;
+    double keep_prob;
+    struct resid_slot *slots;
+    int cap;
+    int used;
 
-    return 0;
-}
+    // since the last report
+    struct timespec last_report;
+    unsigned long switches; // pids that entered focus
+    unsigned long stints;   // focus stints that ended
+    unsigned long stint_ticks;
+    unsigned long focus_slices;
+    unsigned long held;
+};
 
-static int move_pid(const char *group, pid_t pid)
+static unsigned long long read_run_ns(pid_t pid)
 {
-    char path[256];
-    snprintf(path, sizeof(path), "%s/%s/cgroup.procs", CGROUP_ROOT, group);
+    unsigned long long run = 0, wait, slices;
+    int fd = open_proc_fd(pid, "schedstat");
+    if (fd >= 0 && read_schedstat(fd, &run, &wait, &slices) < 0)
+        run = 0;
+    if (fd >= 0)
+        close(fd);
+    return run;
+}
 
-    char buf[32];
-    snprintf(buf, sizeof(buf), "%d", pid);
+static struct resid_slot *resid_get(struct resid_state *r, pid_t pid)
+{
+    if ((r->used + 1) * 2 > r->cap)
+    {
+        int cap = r->cap ? r->cap * 2 : 64;
+        struct resid_slot *slots =
+            (struct resid_slot *)calloc((size_t)cap, sizeof(struct resid_slot));
+        if (!slots)
+            return NULL;
+        struct resid_slot *old = r->slots;
+        int old_cap = r->cap;
+        r->slots = slots;
+        r->cap = cap;
+        r->used = 0;
+        for (int i = 0; i < old_cap; i++)
+        {
+            if (old[i].pid <= 0)
+                continue;
+            unsigned int mask = (unsigned int)cap - 1;
+            unsigned int h = ((unsigned int)old[i].pid * 2654435761u) & mask;
+            while (slots[h].pid != 0)
+                h = (h + 1) & mask;
+            slots[h] = old[i];
+            r->used++;
+        }
+        free(old);
+    }
 
-    if (write_file(path, buf) < 0)
+    unsigned int mask = (unsigned int)r->cap - 1;
+    for (unsigned int h = ((unsigned int)pid * 2654435761u) & mask;; h = (h + 1) & mask)
     {
-        return -1;
+        struct resid_slot *slot = &r->slots[h];
+        if (slot->pid == pid)
+            return slot;
+        if (slot->pid == 0)
+        {
+            memset(slot, 0, sizeof(*slot));
+            slot->pid = pid;
+            slot->run_ns = read_run_ns(pid);
+            r->used++;
+            return slot;
+        }
     }
-    return 0;
 }
 
-static int load_ticket_entries(struct ticket_entry **out_arr, int *out_count)
+// Forgets pids that were not listed in tick.
+static void resid_sweep(struct resid_state *r, unsigned long tick)
 {
-    *out_arr = NULL;
-    *out_count = 0;
+    int stale = 0;
+    for (int i = 0; i < r->cap; i++)
+    {
+        if (r->slots[i].pid > 0 && r->slots[i].seen != tick)
+            stale++;
+    }
+    if (stale == 0)
+        return;
 
-    if (ensure_dir(STATE_DIR) < 0)
-        return -1;
+    struct resid_slot *old = r->slots;
+    int old_cap = r->cap;
+    r->slots = (struct resid_slot *)calloc((size_t)old_cap, sizeof(struct resid_slot));
+    if (!r->slots)
+    {
+        r->slots = old;
+        return;
+    }
+    r->used = 0;
+    unsigned int mask = (unsigned int)old_cap - 1;
+    for (int i = 0; i < old_cap; i++)
+    {
+        if (old[i].pid <= 0 || old[i].seen != tick)
+            continue;
+        unsigned int h = ((unsigned int)old[i].pid * 2654435761u) & mask;
+        while (r->slots[h].pid != 0)
+            h = (h + 1) & mask;
+        r->slots[h] = old[i];
+        r->used++;
+    }
+    free(old);
+}
 
-    FILE *f = fopen(PROCS_FILE, "r");
-    if (!f)
+// Decides before the draw which incumbents stay and who sits it out.
+static void resid_plan(struct resid_state *r, const struct ticket_entry *arr, int count,
+                       unsigned long tick, unsigned char *hold)
+{
+    for (int i = 0; i < count; i++)
     {
-        if (errno == ENOENT)
+        hold[i] = HOLD_NONE;
+        struct resid_slot *slot = resid_get(r, arr[i].pid);
+        if (!slot || arr[i].tickets <= 0)
+            continue;
+        if (slot->focused &&
+            (tick - slot->since < (unsigned long)r->min_ticks ||
+             (r->keep_prob > 0.0 && rand() < r->keep_prob * ((double)RAND_MAX + 1.0))))
         {
-            return 0;
+            hold[i] = HOLD_FOCUS;
+        }
+        else if (slot->debt > 1e-9) // undistorted ticks leave rounding noise
+        {
+            // an incumbent whose hold ran out repays like everyone else
+            hold[i] = HOLD_BARRED;
         }
-        perror(PROCS_FILE);
-        return -1;
     }
+}
 
-    int capacity = 16;
-    int count = 0;
-    struct ticket_entry *arr = (struct ticket_entry *)malloc(sizeof(struct ticket_entry) * capacity);
-    if (!arr)
+/*
+ * Books the draw's outcome.  Each pid is charged q - p, its expected focus
+ * in this tick's restricted draw minus its fair chance p: 1 for a held
+ * incumbent, the renormalized odds for the pids that were drawn from and
+ * 0 (or whatever the top-up gave them) for barred ones.  The charges add
+ * up to zero and the draw itself stays random.
+ */
+static void resid_settle(struct resid_state *r, const struct ticket_entry *arr, int count,
+                         const unsigned char *hold, const unsigned char *tier_of,
+                         unsigned long tick)
+{
+    double total = 0.0, total_free = 0.0, total_barred = 0.0;
+    int nfocused = 0, nheld = 0, nfree = 0;
+    for (int i = 0; i < count; i++)
     {
-        fclose(f);
-        return -1;
+        if (arr[i].tickets <= 0)
+            continue;
+        int focused = tier_of[i] == PLACE_FOCUS;
+        total += arr[i].tickets;
+        nfocused += focused;
+        if (hold[i] == HOLD_FOCUS)
+            nheld += focused;
+        else if (hold[i] == HOLD_BARRED)
+            total_barred += arr[i].tickets;
+        else
+        {
+            total_free += arr[i].tickets;
+            nfree++;
+        }
     }
+    int slots = nfocused - nheld;                  // drawn this tick
+    int topup = slots > nfree ? slots - nfree : 0; // of them from the barred
 
-    while (1)
+    for (int i = 0; i < count; i++)
     {
-        int pid_i = 0;
-        int tickets = 0;
-        int n = fscanf(f, "%d %d", &pid_i, &tickets);
-        if (n == EOF)
-            break;
-        if (n != 2)
-        {
-            char buf[256];
-            if (!fgets(buf, sizeof(buf), f))
-                break;
+        struct resid_slot *slot = resid_get(r, arr[i].pid);
+        if (!slot)
             continue;
+        slot->seen = tick;
+
+        int focused = tier_of[i] == PLACE_FOCUS && arr[i].tickets > 0;
+        if (arr[i].tickets > 0)
+        {
+            double p = nfocused * arr[i].tickets / total;
+            double q = 0.0;
+            if (hold[i] == HOLD_FOCUS)
+                q = focused;
+            else if (hold[i] == HOLD_BARRED && topup > 0)
+                q = topup * arr[i].tickets / total_barred;
+            else if (hold[i] == HOLD_NONE && slots > 0)
+                q = topup > 0 ? 1.0 : slots * arr[i].tickets / total_free;
+            slot->debt += (q < 1.0 ? q : 1.0) - (p < 1.0 ? p : 1.0);
         }
-        if (tickets <= 0)
-            continue;
-        if (pid_i <= 0)
-            continue;
 
-        if (count >= capacity)
+        if (focused)
         {
-            capacity *= 2;
-            struct ticket_entry *tmp =
-                (struct ticket_entry *)realloc(arr, sizeof(struct ticket_entry) * capacity);
-            if (!tmp)
+            r->focus_slices++;
+            if (hold[i] == HOLD_FOCUS)
+                r->held++;
+            if (!slot->focused)
             {
-                free(arr);
-                fclose(f);
-                return -1;
+                slot->since = tick;
+                r->switches++;
             }
-            arr = tmp;
         }
+        else if (slot->focused)
+        {
+            r->stints++;
+            r->stint_ticks += tick - slot->since;
+        }
+        slot->focused = focused;
+    }
+    resid_sweep(r, tick);
+}
+
+static void resid_report(struct resid_state *r, int timeslice_ms)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = timespec_diff_sec(&now, &r->last_report);
+    if (elapsed <= 0.0)
+        return;
 
-        arr[count].pid = (pid_t)pid_i;
-        arr[count].tickets = tickets;
-        count++;
+    // what the lottery's pids got done, summed over all tiers
+    unsigned long long run = 0;
+    for (int i = 0; i < r->cap; i++)
+    {
+        struct resid_slot *slot = &r->slots[i];
+        if (slot->pid <= 0)
+            continue;
+        unsigned long long cur = read_run_ns(slot->pid);
+        if (cur >= slot->run_ns)
+            run += cur - slot->run_ns;
+        slot->run_ns = cur;
     }
 
-    fclose(f);
+    printf("focusd: focus switches %.2f/s", r->switches / elapsed);
+    if (r->stints > 0)
+        printf(", mean stint %.1f ms", (double)r->stint_ticks / r->stints * timeslice_ms);
+    if (r->min_ticks > 0 || r->keep_prob > 0.0)
+        printf(", held %lu of %lu focus slices", r->held, r->focus_slices);
+    printf(", lottery cpu %.2f CPUs\n", run / 1e9 / elapsed);
+    fflush(stdout);
 
-    *out_arr = arr;
-    *out_count = count;
-    return 0;
+    r->last_report = now;
+    r->switches = r->stints = r->stint_ticks = r->focus_slices = r->held = 0;
 }
 
-static pid_t pick_winner(struct ticket_entry *arr, int count)
+/*
+ * Decision trace (TRACE_FILE).  Every tick that runs a draw appends one
+ * fixed-size record to the shared ring: when the tick woke and how late,
+ * who went to focus, the ticket total, the backend calls it made and how
+ * long it took.  Appending is a 64-byte copy into the mapping, so the
+ * trace is always on; focusctl trace decodes it after the fact.
+ */
+
+struct trace_clock
 {
-    if (count <= 0)
-        return -1;
+    struct timespec start; // monotonic, loop wakeup
+    struct timespec due;   // when the preceding sleep should have ended
+    int has_due;           // 0 after an idle wait, which has no deadline
+    uint64_t realtime_ns;
+    uint32_t late_us;
+    unsigned long calls; // act_stats at wakeup
+    unsigned long failures;
+};
 
-    long total = 0;
-    for (int i = 0; i < count; i++)
+static void trace_begin(struct trace_clock *c, const struct act_stats *st)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &c->start);
+    clock_gettime(CLOCK_REALTIME, &now);
+    c->realtime_ns = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+    c->late_us = 0;
+    if (c->has_due && timespec_diff_sec(&c->start, &c->due) > 0.0)
+        c->late_us = (uint32_t)(timespec_diff_sec(&c->start, &c->due) * 1e6);
+    c->has_due = 0; // error paths sleep without trace_sleep()
+    c->calls = st->calls;
+    c->failures = st->failures;
+}
+
+// Called right before wait_next_tick() to know how late the next wakeup is.
+static void trace_sleep(struct trace_clock *c, int idle, int timeslice_ms)
+{
+    c->has_due = !idle;
+    if (idle)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &c->due);
+    c->due.tv_sec += timeslice_ms / 1000;
+    c->due.tv_nsec += (long)(timeslice_ms % 1000) * 1000000L;
+    if (c->due.tv_nsec >= 1000000000L)
     {
-        if (arr[i].tickets > 0)
-            total += arr[i].tickets;
+        c->due.tv_sec++;
+        c->due.tv_nsec -= 1000000000L;
     }
-    if (total <= 0)
-        return -1;
+}
 
-    long r = (rand() % total) + 1; // 1..total
+static void trace_end(struct focus_trace *trace, const struct trace_clock *c,
+                      const struct act_stats *st, const struct ticket_entry *arr,
+                      const unsigned char *tier_of, const unsigned char *hold, int count)
+{
+    if (!trace)
+        return;
 
-    long acc = 0;
+    struct focus_trace_record rec;
+    struct timespec end;
+    memset(&rec, 0, sizeof(rec));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    rec.time_ns = c->realtime_ns;
+    rec.late_us = c->late_us;
+    rec.duration_us = (uint32_t)(timespec_diff_sec(&end, &c->start) * 1e6);
+    rec.entries = (uint32_t)count;
+    rec.writes = (uint16_t)(st->calls - c->calls);
+    rec.failures = (uint16_t)(st->failures - c->failures);
     for (int i = 0; i < count; i++)
     {
-        if (arr[i].tickets <= 0)
+        if (arr[i].tickets > 0)
+            rec.tickets += (uint32_t)arr[i].tickets;
+        if (tier_of[i] != PLACE_FOCUS || arr[i].tickets <= 0)
             continue;
-        acc += arr[i].tickets;
-        if (r <= acc)
-        {
-            return arr[i].pid;
-        }
+        if (rec.nwinners < FOCUS_TRACE_WINNERS)
+            rec.winners[rec.nwinners] = arr[i].pid;
+        rec.nwinners++;
+        if (hold[i] == HOLD_FOCUS)
+            rec.held++;
     }
-    return arr[count - 1].pid;
+    focus_trace_append(trace, &rec);
 }
 
 int main(int argc, char *argv[])
@@ -246,7 +2499,11 @@ int main(int argc, char *argv[])
     if (argc < 2)
     {
         fprintf(stderr,
-                "Usage: %s <timeslice_ms>\n"
+                "Usage: %s <timeslice_ms> [--backend NAME] [--cap-auto [min_percent]]\n"
+                "       [--freeze group|pid] [--auto-tickets MIN:MAX] [--release-orphans]\n"
+                "       [--winners K] [--tier NAME:WEIGHT:COUNT]... [--slo-p99 MS]\n"
+                "       [--min-residency MS] [--keep-prob P]\n"
+                "Backends: migrate (default), weight, nice, sched-idle, sched-batch\n"
                 "Example: sudo %s 100\n",
                 argv[0], argv[0]);
         return 1;
@@ -259,57 +2516,452 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    if (init_cgroups() < 0)
+    int cap_auto = 0;
+    int cap_min_pct = 5;
+    int freeze_mode = FREEZE_NONE;
+    const struct actuator *act = &actuators[0];
+    struct interact_map interact;
+    memset(&interact, 0, sizeof(interact));
+    int auto_tickets = 0;
+    int release_orphans = 0;
+    int winners = 1;
+    struct slo_state slo;
+    memset(&slo, 0, sizeof(slo));
+    int min_residency_ms = 0;
+    struct resid_state resid;
+    memset(&resid, 0, sizeof(resid));
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc)
+        {
+            act = find_actuator(argv[++i]);
+            if (!act)
+            {
+                fprintf(stderr, "Unknown backend: %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--auto-tickets") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (sscanf(argv[i], "%d:%d", &interact.min_tickets, &interact.max_tickets) != 2 ||
+                interact.min_tickets <= 0 || interact.max_tickets < interact.min_tickets)
+            {
+                fprintf(stderr, "--auto-tickets takes MIN:MAX with 0 < MIN <= MAX\n");
+                return 1;
+            }
+            auto_tickets = 1;
+        }
+        else if (strcmp(argv[i], "--winners") == 0 && i + 1 < argc)
+        {
+            winners = atoi(argv[++i]);
+            if (winners <= 0)
+            {
+                fprintf(stderr, "--winners must be > 0\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--tier") == 0 && i + 1 < argc)
+        {
+            if (tier_add(argv[++i]) < 0)
+                return 1;
+        }
+        else if (strcmp(argv[i], "--min-residency") == 0 && i + 1 < argc)
+        {
+            min_residency_ms = atoi(argv[++i]);
+            if (min_residency_ms < 0)
+            {
+                fprintf(stderr, "--min-residency takes milliseconds >= 0\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--keep-prob") == 0 && i + 1 < argc)
+        {
+            resid.keep_prob = atof(argv[++i]);
+            if (resid.keep_prob < 0.0 || resid.keep_prob >= 1.0)
+            {
+                fprintf(stderr, "--keep-prob takes a probability in [0, 1)\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--slo-p99") == 0 && i + 1 < argc)
+        {
+            slo.target_ms = atof(argv[++i]);
+            if (slo.target_ms <= 0.0)
+            {
+                fprintf(stderr, "--slo-p99 takes a delay in milliseconds > 0\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--release-orphans") == 0)
+        {
+            release_orphans = 1;
+        }
+        else if (strcmp(argv[i], "--cap-auto") == 0)
+        {
+            cap_auto = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                cap_min_pct = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--freeze") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "group") == 0)
+                freeze_mode = FREEZE_GROUP;
+            else if (strcmp(argv[i], "pid") == 0)
+                freeze_mode = FREEZE_PID;
+            else
+            {
+                fprintf(stderr, "--freeze takes \"group\" or \"pid\"\n");
+                return 1;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (cap_min_pct <= 0 || cap_min_pct > 100)
+    {
+        fprintf(stderr, "min_percent must be 1..100\n");
+        return 1;
+    }
+    // these act on the focus/background groups that only migrate populates
+    if ((cap_auto || freeze_mode != FREEZE_NONE || slo.target_ms > 0.0) &&
+        strcmp(act->name, "migrate") != 0)
+    {
+        fprintf(stderr, "--cap-auto, --freeze and --slo-p99 require the migrate backend\n");
+        return 1;
+    }
+    if (cap_auto && slo.target_ms > 0.0)
+    {
+        fprintf(stderr, "--cap-auto and --slo-p99 both drive background cpu.max\n");
+        return 1;
+    }
+    if (strcmp(act->name, "sched-batch") == 0)
+        sched_bg_policy = SCHED_BATCH;
+
+    if (act->cgroups && focus_init_cgroups(NULL) < 0)
     {
         fprintf(stderr, "Failed to init cgroups.\n");
         return 1;
     }
+    if (act->place == migrate_place && tiers_init_groups() < 0)
+    {
+        fprintf(stderr, "Failed to create the --tier groups.\n");
+        return 1;
+    }
+    if (focus_ensure_dir(STATE_DIR) < 0)
+        return 1;
+
+    if (act->init && act->init() < 0)
+    {
+        fprintf(stderr, "Failed to init %s backend.\n", act->name);
+        return 1;
+    }
+
+    // wins are best-effort: focusd schedules without the export
+    struct focus_wins *wins = focus_wins_map(1);
+    struct focus_trace *trace = focus_trace_map(1);
+    if (auto_tickets)
+        focus_raise_nofile();
+
+    tiers[PLACE_FOCUS].size = winners;
+    slo.max_winners = winners;
+    resid.min_ticks = (min_residency_ms + timeslice_ms - 1) / timeslice_ms;
+    if (slo.target_ms > 0.0)
+    {
+        restore_bg_cpu_max();
+        slo_reset(&slo);
+    }
+
+    struct cap_state cap;
+    memset(&cap, 0, sizeof(cap));
+    if (cap_auto && cap_auto_init(&cap, cap_min_pct) < 0)
+    {
+        fprintf(stderr, "Failed to set up --cap-auto.\n");
+        return 1;
+    }
+
+    struct freeze_state fz;
+    memset(&fz, 0, sizeof(fz));
+    fz.mode = freeze_mode;
 
+    // stop cleanly so frozen processes are thawed before exit
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    profiles_stat(&profiles_mtime);
     srand((unsigned int)time(NULL));
+    ns_per_tick = 1000000000LL / sysconf(_SC_CLK_TCK);
 
-    printf("focusd: user-level lottery scheduler started (timeslice=%d ms).\n", timeslice_ms);
-    printf("It will read %s for (pid, tickets) entries.\n", PROCS_FILE);
+    printf("focusd: user-level lottery scheduler started (timeslice=%d ms, backend=%s).\n",
+           timeslice_ms, act->name);
+    printf("It will follow %s and %s for (pid, tickets) entries.\n", PROCS_FILE, JOURNAL_FILE);
+    if (cap.enabled)
+        printf("Background cpu.max follows focus demand (floor %d%% of a CPU).\n", cap.min_pct);
+    if (auto_tickets)
+        printf("Interactive processes get %dx tickets within [%d, %d].\n", AUTO_BOOST,
+               interact.min_tickets, interact.max_tickets);
+    if (winners > 1)
+        printf("Up to %d winners are focused per slice.\n", winners);
+    for (int t = 1; t < bg_tier(); t++)
+        printf("Then up to %d to group %s (weight %d).\n", tiers[t].size, tiers[t].name,
+               tiers[t].weight);
+    if (slo.target_ms > 0.0)
+        printf("Holding focused run-queue delay at p99 < %.2f ms.\n", slo.target_ms);
+    if (resid.min_ticks > 0)
+        printf("Winners keep focus for at least %d ms.\n", resid.min_ticks * timeslice_ms);
+    if (resid.keep_prob > 0.0)
+        printf("Incumbents keep focus with probability %.2f per slice.\n", resid.keep_prob);
+    if (fz.mode == FREEZE_GROUP)
+        printf("Background group is frozen while a focus winner runs.\n");
+    else if (fz.mode == FREEZE_PID)
+        printf("Losing processes are frozen in per-pid cgroups while a slice runs.\n");
 
-    for (;;)
+    struct placement_map placed;
+    struct act_stats act_st;
+    memset(&placed, 0, sizeof(placed));
+    memset(&act_st, 0, sizeof(act_st));
+    reconcile_startup(act, &placed, release_orphans);
+    unsigned long tick = 0;
+    time_t last_stats = time(NULL);
+    clock_gettime(CLOCK_MONOTONIC, &resid.last_report);
+
+    // tails the journal; arr is this tick's copy, interact_adjust edits it
+    struct focus_ticket_reader *tickets = focus_tickets_open();
+    struct ticket_entry *arr = NULL;
+    int arr_cap = 0;
+    if (!tickets)
+    {
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+
+    // --cap-auto and --slo-p99 follow CPU usage, so they keep ticking
+    int watch_fd = (cap.enabled || slo.target_ms > 0.0) ? -1 : idle_watch_open();
+    unsigned char *tier_of = NULL;
+    unsigned char *hold = NULL;
+    struct rank_key *keys = NULL;
+    int idle = 0;
+    struct trace_clock tclock;
+    memset(&tclock, 0, sizeof(tclock));
+
+    struct rule_engine rules;
+    rules_init(&rules, act->cgroups);
+
+    while (!stop_requested)
     {
-        struct ticket_entry *arr = NULL;
+        const struct ticket_entry *state = NULL;
         int count = 0;
 
-        if (load_ticket_entries(&arr, &count) < 0)
+        trace_begin(&tclock, &act_st);
+        idle_watch_drain(watch_fd);
+        // before the poll, so the tickets rules hand out count this tick
+        rules_tick(&rules);
+
+        // a reloaded profile may have overwritten cpu.max and cpu.weight
+        if (act->cgroups && reload_profiles_if_changed())
+        {
+            cap.quota = -1;
+            if (act->place == weight_place)
+            {
+                weight_load_profile();
+                placement_invalidate(&placed);
+            }
+            if (slo.target_ms > 0.0)
+            {
+                restore_bg_cpu_max();
+                slo_reset(&slo);
+            }
+        }
+        if (cap.enabled)
+            cap_auto_tick(&cap);
+
+        if (focus_tickets_poll(tickets, &state, &count) < 0)
         {
             fprintf(stderr, "Error loading ticket entries. Sleeping...\n");
             usleep(timeslice_ms * 1000);
             continue;
         }
+        if (count > arr_cap)
+        {
+            struct ticket_entry *tmp =
+                (struct ticket_entry *)realloc(arr, sizeof(struct ticket_entry) * count);
+            if (!tmp)
+            {
+                usleep(timeslice_ms * 1000);
+                continue;
+            }
+            arr = tmp;
+            unsigned char *flags = (unsigned char *)realloc(tier_of, (size_t)count);
+            if (!flags)
+            {
+                usleep(timeslice_ms * 1000);
+                continue;
+            }
+            tier_of = flags;
+            flags = (unsigned char *)realloc(hold, (size_t)count);
+            if (!flags)
+            {
+                usleep(timeslice_ms * 1000);
+                continue;
+            }
+            hold = flags;
+            struct rank_key *k = (struct rank_key *)realloc(keys, sizeof(struct rank_key) * count);
+            if (!k)
+            {
+                usleep(timeslice_ms * 1000);
+                continue;
+            }
+            keys = k;
+            arr_cap = count;
+        }
+        if (count > 0)
+            memcpy(arr, state, sizeof(struct ticket_entry) * count);
+        count = rules_reap(&rules, arr, count);
 
         if (count <= 0)
         {
             // nothing to schedule
-            usleep(timeslice_ms * 1000);
-            free(arr);
+            if (fz.group_frozen)
+                freeze_group(&fz, 0);
+            if (!idle && watch_fd >= 0)
+                printf("focusd: no contest, idle until the ticket state changes.\n");
+            idle = (watch_fd >= 0);
+            trace_sleep(&tclock, idle, timeslice_ms);
+            wait_next_tick(watch_fd, &rules, idle, timeslice_ms);
             continue;
         }
 
-        pid_t winner = pick_winner(arr, count);
+        tick++;
+        if (auto_tickets)
+            interact_adjust(&interact, arr, count, tick);
+        if (slo.target_ms > 0.0)
+        {
+            slo_begin_tick(&slo, tick);
+            winners = slo.winners;
+            tiers[PLACE_FOCUS].size = winners;
+        }
+        resid_plan(&resid, arr, count, tick, hold);
+        int nwon = rank_tiers(arr, count, hold, keys, tier_of);
+        resid_settle(&resid, arr, count, hold, tier_of, tick);
 
-        if (winner > 0)
+        if (nwon > 0)
         {
+            if (wins)
+                focus_wins_tick(wins);
+            for (int i = 0; i < count; i++)
+            {
+                if (wins && tier_of[i] == PLACE_FOCUS)
+                    focus_wins_add(wins, arr[i].pid);
+            }
             for (int i = 0; i < count; i++)
             {
-                if (arr[i].pid == winner)
+                // only the background tier is frozen, the others keep running
+                int t = tier_of[i];
+                int parked = (fz.mode == FREEZE_PID) ? freeze_find(&fz, arr[i].pid) : -1;
+                if (t != bg_tier() && parked >= 0)
+                {
+                    thaw_pid(&fz, parked, tiers[t].name);
+                    placement_mark(&placed, arr[i].pid, t, tick);
+                }
+                else if (t == bg_tier() && fz.mode == FREEZE_PID)
                 {
-                    move_pid(FOCUS_NAME, arr[i].pid);
+                    if (parked >= 0 || freeze_pid(&fz, arr[i].pid) == 0)
+                        placement_mark(&placed, arr[i].pid, PLACE_FROZEN, tick);
+                    else if (actuate(act, &placed, &act_st, arr[i].pid, t, tick) == -ESRCH)
+                        rules_note_exit(&rules, arr[i].pid);
                 }
-                else
+                else if (actuate(act, &placed, &act_st, arr[i].pid, t, tick) == -ESRCH)
                 {
-                    move_pid(BG_NAME, arr[i].pid);
+                    rules_note_exit(&rules, arr[i].pid);
                 }
             }
+            placement_sweep(&placed, act, tick);
+
+            // pids removed from the lottery must not stay frozen
+            for (int j = fz.nfrozen - 1; j >= 0; j--)
+            {
+                int listed = 0;
+                for (int i = 0; i < count && !listed; i++)
+                    listed = (arr[i].pid == fz.frozen[j]);
+                if (!listed)
+                    thaw_pid(&fz, j, NULL);
+            }
+
+            if (fz.mode == FREEZE_GROUP)
+                freeze_group(&fz, 1);
+            if (slo.target_ms > 0.0)
+                slo_end_tick(&slo, arr, tier_of, count, tick);
         }
+        else if (fz.group_frozen)
+        {
+            freeze_group(&fz, 0); // nobody in focus to hand the CPU to
+        }
+        trace_end(trace, &tclock, &act_st, arr, tier_of, hold, count);
 
-        free(arr);
-        usleep(timeslice_ms * 1000);
+        if (time(NULL) - last_stats >= STATS_INTERVAL_SEC)
+        {
+            print_act_stats(act, &act_st);
+            resid_report(&resid, timeslice_ms);
+            if (fz.mode != FREEZE_NONE)
+                print_freeze_stats(&fz);
+            last_stats = time(NULL);
+        }
+
+        int settled = lottery_settled(arr, count, winners, &placed) && watch_fd >= 0;
+        if (settled && !idle)
+            printf("focusd: no contest, idle until the ticket state changes.\n");
+        else if (!settled && idle)
+            printf("focusd: contest resumed, ticking every %d ms.\n", timeslice_ms);
+        idle = settled;
+        if (idle && fz.group_frozen)
+            freeze_group(&fz, 0);
+        trace_sleep(&tclock, idle, timeslice_ms);
+        wait_next_tick(watch_fd, &rules, idle, timeslice_ms);
     }
 
+    thaw_all(&fz);
+    // hand every pid back to default scheduling (a no-op for migrate)
+    placement_sweep(&placed, act, tick + 1);
+    if (act->place == migrate_place)
+        tiers_remove_groups();
+    print_act_stats(act, &act_st);
+    resid_report(&resid, timeslice_ms);
+    if (fz.mode != FREEZE_NONE)
+        print_freeze_stats(&fz);
+    free(fz.frozen);
+    free(placed.slots);
+    free(arr);
+    free(tier_of);
+    free(hold);
+    free(keys);
+    free(resid.slots);
+    focus_tickets_close(tickets);
+    if (watch_fd >= 0)
+        close(watch_fd);
+    rules_free(&rules);
+    interact_sweep(&interact, tick + 1);
+    free(interact.slots);
+    if (cap.enabled)
+        cap_auto_restore(&cap);
+    if (slo.target_ms > 0.0)
+    {
+        // put background back to its profile
+        struct focus_profile profile;
+        if (focus_load_profiles(&profile) == 0)
+            focus_apply_profiles(&profile);
+        restore_bg_cpu_max();
+        slo_sweep(&slo, tick + 1);
+        free(slo.slots);
+    }
+    focus_wins_unmap(wins);
+    focus_trace_unmap(trace);
+    printf("focusd: stopped.\n");
     return 0;
 }
\ No newline at end of file
@@ -1,10 +1,18 @@
-g++ -o focusd focusd.c
-g++ -o focusctl focusctl.c
+gcc -Wall -O2 -c libfocus.c -o libfocus.o
+ar rcs libfocus.a libfocus.o
 
-cp focusctl focusd /usr/local/bin/
+g++ -pthread -o focusd focusd.c libfocus.a -lm
+g++ -pthread -o focusctl focusctl.c libfocus.a
+g++ -pthread -o focusbench focusbench.c libfocus.a -lm
+
+cp focusctl focusd focusbench /usr/local/bin/
 
 chmod +x /usr/local/bin/focusctl
 chmod +x /usr/local/bin/focusd
+chmod +x /usr/local/bin/focusbench
+
+cp libfocus.h /usr/local/include/
+cp libfocus.a /usr/local/lib/
 
 sudo mkdir -p /var/lib/focusctl
 
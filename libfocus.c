@@ -0,0 +1,2255 @@
+// libfocus.c - shared implementation behind libfocus.h
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/file.h> // flock
+#include <sys/syscall.h>
+#include <dirent.h> // DT_DIR
+#include <pthread.h>
+
+#include "libfocus.h"
+
+int focus_write_file(const char *path, const char *value)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+    if (fprintf(f, "%s\n", value) < 0)
+    {
+        perror("fprintf");
+        fclose(f);
+        return -1;
+    }
+    if (fclose(f) != 0)
+    {
+        perror("fclose");
+        return -1;
+    }
+    return 0;
+}
+
+int focus_ensure_dir(const char *path)
+{
+    if (mkdir(path, 0755) < 0)
+    {
+        if (errno == EEXIST)
+            return 0;
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+int focus_check_cgroup_v2(void)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/cgroup.controllers", CGROUP_ROOT);
+    if (access(path, F_OK) != 0)
+    {
+        fprintf(stderr, "cgroup v2 not found at %s\n", CGROUP_ROOT);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Resource profiles.
+ *
+ * A profile is a list of (group, knob, value) settings written into the
+ * focus and background cgroups.  The built-in defaults keep the
+ * cpu.weight 1000/10 split and give the same split to io.weight;
+ * PROFILES_FILE overrides or extends them with "<group> <knob> <value>"
+ * lines.  All knobs are set on the group itself, so a single migration
+ * into cgroup.procs moves a process onto every resource at once.  Knobs
+ * the last applied profile set and the new one leaves out are put back to
+ * the kernel default on apply.
+ */
+
+static const char *const profile_knob_names[] = {
+    "cpu.weight", "cpu.max", "cpu.max.burst", "io.weight", "io.max",
+    "memory.low", "memory.high", NULL};
+
+// kernel defaults, written back when a knob is dropped from the profile;
+// io.max has one line per limited device and is reset device by device
+static const char *const profile_knob_resets[] = {
+    "100", "max", "0", "default 100", NULL,
+    "0", "max", NULL};
+
+static const char *const profile_controllers[] = {"cpu", "io", "memory", NULL};
+
+static int has_token(const char *list, const char *name)
+{
+    size_t len = strlen(name);
+    for (const char *p = list; (p = strstr(p, name)) != NULL; p += len)
+    {
+        int starts = (p == list || isspace((unsigned char)p[-1]));
+        int ends = (p[len] == '\0' || isspace((unsigned char)p[len]));
+        if (starts && ends)
+            return 1;
+    }
+    return 0;
+}
+
+static int profile_knob_valid(const char *knob)
+{
+    for (int i = 0; profile_knob_names[i]; i++)
+    {
+        if (strcmp(profile_knob_names[i], knob) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+// cpu.max.burst needs Linux 5.14; io and memory need their controllers
+static int profile_knob_required(const char *knob)
+{
+    return strcmp(knob, "cpu.weight") == 0 || strcmp(knob, "cpu.max") == 0;
+}
+
+static int profile_group_valid(const char *group)
+{
+    return strcmp(group, FOCUS_NAME) == 0 || strcmp(group, BG_NAME) == 0;
+}
+
+// memory.* accept K/M/G/T suffixes; the kernel only takes bytes or "max".
+static int normalize_profile_value(const char *knob, const char *value, char *out, size_t size)
+{
+    if (strncmp(knob, "memory.", 7) != 0 || strcmp(value, "max") == 0)
+    {
+        snprintf(out, size, "%s", value);
+        return 0;
+    }
+
+    char *end = NULL;
+    unsigned long long bytes = strtoull(value, &end, 10);
+    if (end == value)
+        return -1;
+    switch (toupper((unsigned char)*end))
+    {
+    case 'T':
+        bytes <<= 10;
+        // fallthrough
+    case 'G':
+        bytes <<= 10;
+        // fallthrough
+    case 'M':
+        bytes <<= 10;
+        // fallthrough
+    case 'K':
+        bytes <<= 10;
+        end++;
+        break;
+    case '\0':
+        break;
+    default:
+        return -1;
+    }
+    if (*end != '\0')
+        return -1;
+    snprintf(out, size, "%llu", bytes);
+    return 0;
+}
+
+int focus_profile_set(struct focus_profile *p, const char *group, const char *knob,
+                       const char *value)
+{
+    if (!profile_group_valid(group))
+    {
+        fprintf(stderr, "Unknown profile group: %s\n", group);
+        return -1;
+    }
+    if (!profile_knob_valid(knob))
+    {
+        fprintf(stderr, "Unsupported profile knob: %s\n", knob);
+        return -1;
+    }
+
+    char norm[128];
+    if (normalize_profile_value(knob, value, norm, sizeof(norm)) < 0)
+    {
+        fprintf(stderr, "Invalid value for %s: %s\n", knob, value);
+        return -1;
+    }
+
+    struct profile_knob *k = NULL;
+    for (int i = 0; i < p->count; i++)
+    {
+        if (strcmp(p->knobs[i].group, group) == 0 && strcmp(p->knobs[i].knob, knob) == 0)
+        {
+            k = &p->knobs[i];
+            break;
+        }
+    }
+    if (!k)
+    {
+        if (p->count >= MAX_PROFILE_KNOBS)
+        {
+            fprintf(stderr, "Too many profile settings.\n");
+            return -1;
+        }
+        k = &p->knobs[p->count++];
+        snprintf(k->group, sizeof(k->group), "%s", group);
+        snprintf(k->knob, sizeof(k->knob), "%s", knob);
+    }
+    snprintf(k->value, sizeof(k->value), "%s", norm);
+    return 0;
+}
+
+void focus_profile_defaults(struct focus_profile *p)
+{
+    p->count = 0;
+    focus_profile_set(p, FOCUS_NAME, "cpu.weight", "1000");
+    focus_profile_set(p, FOCUS_NAME, "io.weight", "1000");
+    focus_profile_set(p, BG_NAME, "cpu.weight", "10");
+    focus_profile_set(p, BG_NAME, "io.weight", "10");
+}
+
+// Adds the "<group> <knob> <value>" lines of path to p.
+static int read_profile_file(const char *path, struct focus_profile *p)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        if (errno == ENOENT)
+            return 0;
+        perror(path);
+        return -1;
+    }
+
+    char line[256];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f))
+    {
+        lineno++;
+        char *nl = strchr(line, '\n');
+        if (nl)
+            *nl = '\0';
+
+        size_t len = strlen(line);
+        while (len > 0 && isspace((unsigned char)line[len - 1]))
+            line[--len] = '\0';
+
+        char group[32], knob[32];
+        int off = 0;
+        if (line[0] == '#' || sscanf(line, "%31s %31s %n", group, knob, &off) < 2 ||
+            off == 0 || line[off] == '\0')
+            continue;
+        if (focus_profile_set(p, group, knob, line + off) < 0)
+            fprintf(stderr, "%s:%d: ignoring setting\n", path, lineno);
+    }
+
+    fclose(f);
+    return 0;
+}
+
+int focus_load_profiles(struct focus_profile *p)
+{
+    focus_profile_defaults(p);
+    return read_profile_file(PROFILES_FILE, p);
+}
+
+static int write_profile_file(const char *path, const struct focus_profile *p)
+{
+    if (focus_ensure_dir(STATE_DIR) < 0)
+        return -1;
+
+    FILE *f = fopen(path, "w");
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+    fprintf(f, "# <group> <knob> <value>\n");
+    for (int i = 0; i < p->count; i++)
+    {
+        fprintf(f, "%s %s %s\n", p->knobs[i].group, p->knobs[i].knob, p->knobs[i].value);
+    }
+    if (fclose(f) != 0)
+    {
+        perror("fclose");
+        return -1;
+    }
+    return 0;
+}
+
+int focus_enable_controllers(void)
+{
+    char path[256];
+    char avail[256] = {0};
+    char enabled[256] = {0};
+
+    snprintf(path, sizeof(path), "%s/cgroup.controllers", CGROUP_ROOT);
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+    if (!fgets(avail, sizeof(avail), f))
+        avail[0] = '\0';
+    fclose(f);
+
+    snprintf(path, sizeof(path), "%s/cgroup.subtree_control", CGROUP_ROOT);
+    f = fopen(path, "r");
+    if (f)
+    {
+        if (!fgets(enabled, sizeof(enabled), f))
+            enabled[0] = '\0';
+        fclose(f);
+    }
+
+    for (int i = 0; profile_controllers[i]; i++)
+    {
+        const char *name = profile_controllers[i];
+        if (!has_token(avail, name) || has_token(enabled, name))
+            continue;
+
+        char ctl[32];
+        snprintf(ctl, sizeof(ctl), "+%s", name);
+        if (focus_write_file(path, ctl) < 0)
+        {
+            fprintf(stderr, "Failed to enable %s controller\n", name);
+            if (strcmp(name, "cpu") == 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Writes every knob of the profile.  cpu.weight and cpu.max are
+ * mandatory; the other knobs are skipped with a warning when this host
+ * does not provide them.
+ */
+// Splits s in place into at most max whitespace separated tokens.
+static int split_tokens(char *s, char **tok, int max)
+{
+    char *save = NULL;
+    int n = 0;
+    for (char *t = strtok_r(s, " \t", &save); t && n < max; t = strtok_r(NULL, " \t", &save))
+        tok[n++] = t;
+    return n;
+}
+
+/*
+ * Whether the knob at path already holds value, so that re-running init
+ * or restarting focusd does not rewrite unchanged settings.  Reads come
+ * back normalised ("max 100000" for "max", "default 100" for "100",
+ * one "MAJ:MIN key=val ..." line per device), so value matches when its
+ * tokens are a prefix of the matching line, ignoring a leading "default".
+ */
+static int knob_matches(const char *path, const char *value)
+{
+    char cur[1024];
+    char want[256];
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return 0;
+    size_t n = fread(cur, 1, sizeof(cur) - 1, f);
+    fclose(f);
+    cur[n] = '\0';
+    snprintf(want, sizeof(want), "%s", value);
+
+    char *wt[16];
+    int nw = split_tokens(want, wt, 16);
+    if (nw == 0)
+        return 0;
+
+    char *save = NULL;
+    for (char *line = strtok_r(cur, "\n", &save); line; line = strtok_r(NULL, "\n", &save))
+    {
+        char *ct[16];
+        int nc = split_tokens(line, ct, 16);
+        int skip = (nc > 0 && strcmp(ct[0], "default") == 0 && strcmp(wt[0], "default") != 0);
+        if (nc - skip < nw)
+            continue;
+
+        int same = 1;
+        for (int i = 0; i < nw && same; i++)
+            same = (strcmp(ct[i + skip], wt[i]) == 0);
+        if (same)
+            return 1;
+    }
+    return 0;
+}
+
+static int profile_has_knob(const struct focus_profile *p, const char *group, const char *knob)
+{
+    for (int i = 0; i < p->count; i++)
+    {
+        if (strcmp(p->knobs[i].group, group) == 0 && strcmp(p->knobs[i].knob, knob) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+static void reset_io_max(const char *path)
+{
+    char cur[1024];
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return;
+    size_t n = fread(cur, 1, sizeof(cur) - 1, f);
+    fclose(f);
+    cur[n] = '\0';
+
+    char *save = NULL;
+    for (char *line = strtok_r(cur, "\n", &save); line; line = strtok_r(NULL, "\n", &save))
+    {
+        char dev[32], val[96];
+        if (sscanf(line, "%31s", dev) != 1)
+            continue;
+        snprintf(val, sizeof(val), "%s rbps=max wbps=max riops=max wiops=max", dev);
+        focus_write_file(path, val);
+    }
+}
+
+/*
+ * Knobs the previously applied profile (APPLIED_PROFILE_FILE) set but p
+ * does not would otherwise keep their old values until reboot, so they go
+ * back to the kernel default.  Knobs no profile ever set are left alone:
+ * they may be managed at runtime (focusd's cpu.max) or by hand.
+ */
+static void reset_dropped_knobs(const struct focus_profile *p)
+{
+    struct focus_profile prev;
+    prev.count = 0;
+    if (read_profile_file(APPLIED_PROFILE_FILE, &prev) < 0)
+        return;
+
+    for (int k = 0; k < prev.count; k++)
+    {
+        const struct profile_knob *old = &prev.knobs[k];
+        if (profile_has_knob(p, old->group, old->knob))
+            continue;
+        int i = 0;
+        while (profile_knob_names[i] && strcmp(profile_knob_names[i], old->knob) != 0)
+            i++;
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%s/%s", CGROUP_ROOT, old->group, old->knob);
+        if (!profile_knob_names[i] || access(path, F_OK) != 0)
+            continue;
+        if (!profile_knob_resets[i])
+            reset_io_max(path);
+        else if (!knob_matches(path, profile_knob_resets[i]))
+            focus_write_file(path, profile_knob_resets[i]);
+    }
+}
+
+int focus_apply_profiles(const struct focus_profile *p)
+{
+    int rc = 0;
+    reset_dropped_knobs(p);
+    write_profile_file(APPLIED_PROFILE_FILE, p);
+    for (int i = 0; i < p->count; i++)
+    {
+        const struct profile_knob *k = &p->knobs[i];
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%s/%s", CGROUP_ROOT, k->group, k->knob);
+
+        if (!profile_knob_required(k->knob) && access(path, F_OK) != 0)
+        {
+            fprintf(stderr, "Skipping %s on %s: controller not available\n", k->knob, k->group);
+            continue;
+        }
+        if (knob_matches(path, k->value))
+            continue;
+        if (focus_write_file(path, k->value) < 0)
+        {
+            if (profile_knob_required(k->knob))
+                rc = -1;
+        }
+    }
+    return rc;
+}
+
+int focus_save_profiles(const struct focus_profile *p)
+{
+    return write_profile_file(PROFILES_FILE, p);
+}
+
+int focus_init_cgroups(struct focus_profile *out_profile)
+{
+    char path[256];
+    struct focus_profile profile;
+
+    if (focus_check_cgroup_v2() < 0)
+    {
+        return -1;
+    }
+
+    if (focus_enable_controllers() < 0)
+        return -1;
+
+    snprintf(path, sizeof(path), "%s/%s", CGROUP_ROOT, FOCUS_NAME);
+    if (focus_ensure_dir(path) < 0)
+        return -1;
+
+    snprintf(path, sizeof(path), "%s/%s", CGROUP_ROOT, BG_NAME);
+    if (focus_ensure_dir(path) < 0)
+        return -1;
+
+    if (focus_load_profiles(&profile) < 0)
+        return -1;
+    if (focus_apply_profiles(&profile) < 0)
+        return -1;
+
+    if (focus_ensure_dir(STATE_DIR) < 0)
+        return -1;
+
+    if (out_profile)
+        *out_profile = profile;
+    return 0;
+}
+
+static void group_procs_path(const char *group, char *out, size_t size)
+{
+    if (group)
+        snprintf(out, size, "%s/%s/cgroup.procs", CGROUP_ROOT, group);
+    else
+        snprintf(out, size, "%s/cgroup.procs", CGROUP_ROOT);
+}
+
+int focus_move_pid(const char *group, pid_t pid)
+{
+    char path[256];
+    group_procs_path(group, path, sizeof(path));
+
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%d", pid);
+
+    return focus_write_file(path, buf);
+}
+
+/*
+ * Ticket state.
+ *
+ * PROCS_FILE is a snapshot of "pid tickets" lines.  Every change after it
+ * is appended to JOURNAL_FILE as an "s <pid> <tickets>" (set) or
+ * "r <pid>" (remove) line through one O_APPEND write, so a mutation
+ * costs O(1) instead of rewriting the state.  The journal starts with a
+ * "# focus journal <gen>" header.  Appenders and readers hold a shared
+ * flock() on it; compaction holds it exclusively, replaces the snapshot
+ * through rename() and truncates the journal under the next generation,
+ * which tells tailing readers to start over.  Replaying a journal over a
+ * snapshot that already contains it yields the same state, so a crash
+ * between the rename and the truncate is harmless.
+ */
+
+#define JOURNAL_HEADER "# focus journal "
+#define JOURNAL_COMPACT_BYTES 65536
+
+struct ticket_state
+{
+    struct ticket_entry *arr; // tickets 0 marks a removed pid until packed
+    int count;
+    int cap;
+    int *index; // open addressing on pid, position in arr + 1
+    int index_cap;
+};
+
+static void state_free(struct ticket_state *st)
+{
+    free(st->arr);
+    free(st->index);
+    memset(st, 0, sizeof(*st));
+}
+
+static int state_reindex(struct ticket_state *st, int index_cap)
+{
+    int *index = (int *)calloc((size_t)index_cap, sizeof(int));
+    if (!index)
+        return -1;
+    free(st->index);
+    st->index = index;
+    st->index_cap = index_cap;
+
+    unsigned int mask = (unsigned int)index_cap - 1;
+    for (int i = 0; i < st->count; i++)
+    {
+        unsigned int h = ((unsigned int)st->arr[i].pid * 2654435761u) & mask;
+        while (index[h] != 0)
+            h = (h + 1) & mask;
+        index[h] = i + 1;
+    }
+    return 0;
+}
+
+// Returns 1 if the ticket changed, 0 if it already had that value, -1 on error.
+static int state_set(struct ticket_state *st, pid_t pid, int tickets)
+{
+    if (pid <= 0)
+        return -1;
+    if (tickets < 0)
+        tickets = 0;
+
+    if ((st->count + 1) * 2 > st->index_cap &&
+        state_reindex(st, st->index_cap ? st->index_cap * 2 : 64) < 0)
+        return -1;
+
+    unsigned int mask = (unsigned int)st->index_cap - 1;
+    unsigned int h = ((unsigned int)pid * 2654435761u) & mask;
+    for (; st->index[h] != 0; h = (h + 1) & mask)
+    {
+        if (st->arr[st->index[h] - 1].pid == pid)
+        {
+            if (st->arr[st->index[h] - 1].tickets == tickets)
+                return 0;
+            st->arr[st->index[h] - 1].tickets = tickets;
+            return 1;
+        }
+    }
+    if (tickets == 0)
+        return 0; // removing a pid that is not there
+
+    if (st->count >= st->cap)
+    {
+        int cap = st->cap ? st->cap * 2 : 16;
+        struct ticket_entry *tmp =
+            (struct ticket_entry *)realloc(st->arr, sizeof(struct ticket_entry) * cap);
+        if (!tmp)
+            return -1;
+        st->arr = tmp;
+        st->cap = cap;
+    }
+    st->arr[st->count].pid = pid;
+    st->arr[st->count].tickets = tickets;
+    st->index[h] = ++st->count;
+    return 1;
+}
+
+// Drops removed pids, keeping the order of the rest.
+static void state_pack(struct ticket_state *st)
+{
+    int n = 0;
+    for (int i = 0; i < st->count; i++)
+    {
+        if (st->arr[i].tickets > 0)
+            st->arr[n++] = st->arr[i];
+    }
+    if (n != st->count)
+    {
+        st->count = n;
+        if (state_reindex(st, st->index_cap) < 0)
+            st->index_cap = 0; // rebuilt on the next state_set
+    }
+}
+
+static int state_load_snapshot(struct ticket_state *st)
+{
+    FILE *f = fopen(PROCS_FILE, "r");
+    if (!f)
+    {
+        if (errno == ENOENT)
+        {
+            return 0;
+        }
+        perror(PROCS_FILE);
+        return -1;
+    }
+
+    while (1)
+    {
+        int pid_i = 0;
+        int tickets = 0;
+        int n = fscanf(f, "%d %d", &pid_i, &tickets);
+        if (n == EOF)
+            break;
+        if (n != 2)
+        {
+            char buf[256];
+            if (!fgets(buf, sizeof(buf), f))
+                break;
+            continue;
+        }
+        if (tickets <= 0)
+            continue;
+        if (pid_i <= 0)
+            continue;
+
+        if (state_set(st, (pid_t)pid_i, tickets) < 0)
+        {
+            fclose(f);
+            return -1;
+        }
+    }
+
+    fclose(f);
+    return 0;
+}
+
+// Applies one journal line; returns 1 if it changed a ticket.
+static int apply_record(struct ticket_state *st, const char *line, unsigned int *gen)
+{
+    int pid_i = 0;
+    int tickets = 0;
+
+    if (strncmp(line, JOURNAL_HEADER, strlen(JOURNAL_HEADER)) == 0)
+    {
+        *gen = (unsigned int)strtoul(line + strlen(JOURNAL_HEADER), NULL, 10);
+        return 0;
+    }
+    if (sscanf(line, "s %d %d", &pid_i, &tickets) == 2)
+        return state_set(st, (pid_t)pid_i, tickets) > 0;
+    if (sscanf(line, "r %d", &pid_i) == 1)
+        return state_set(st, (pid_t)pid_i, 0) > 0;
+    return 0;
+}
+
+// Applies the complete lines from *pos on and advances *pos past them.
+static int replay_journal(int fd, struct ticket_state *st, off_t *pos, unsigned int *gen)
+{
+    char buf[16384];
+    size_t have = 0;
+    int applied = 0;
+
+    for (;;)
+    {
+        ssize_t n = pread(fd, buf + have, sizeof(buf) - 1 - have, *pos + (off_t)have);
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        have += (size_t)n;
+        buf[have] = '\0';
+
+        char *line = buf;
+        char *nl;
+        while ((nl = (char *)memchr(line, '\n', (size_t)(buf + have - line))) != NULL)
+        {
+            *nl = '\0';
+            applied += apply_record(st, line, gen);
+            line = nl + 1;
+        }
+
+        size_t used = (size_t)(line - buf);
+        if (used == 0 && have == sizeof(buf) - 1)
+            used = have; // no newline in a full buffer: not a record, skip it
+        *pos += (off_t)used;
+        memmove(buf, buf + used, have - used);
+        have -= used;
+    }
+    return applied;
+}
+
+static unsigned int journal_gen(int fd)
+{
+    char buf[64];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0)
+        return 0;
+    buf[n] = '\0';
+    if (strncmp(buf, JOURNAL_HEADER, strlen(JOURNAL_HEADER)) != 0)
+        return 0;
+    return (unsigned int)strtoul(buf + strlen(JOURNAL_HEADER), NULL, 10);
+}
+
+static int open_journal(int create)
+{
+    int fd = open(JOURNAL_FILE, O_RDWR | O_APPEND | O_CLOEXEC | (create ? O_CREAT : 0), 0644);
+    if (fd < 0 && !create && errno == EACCES)
+        fd = open(JOURNAL_FILE, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 && (create || errno != ENOENT))
+        perror(JOURNAL_FILE);
+    return fd;
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int write_journal_header(int fd, unsigned int gen)
+{
+    char buf[64];
+    int len = snprintf(buf, sizeof(buf), "%s%u\n", JOURNAL_HEADER, gen);
+    return write_all(fd, buf, (size_t)len);
+}
+
+/*
+ * Writes st as the new snapshot and restarts the journal under the next
+ * generation.  The caller holds LOCK_EX on jfd.
+ */
+static int compact_locked(int jfd, const struct ticket_state *st)
+{
+    char tmp[sizeof(PROCS_FILE) + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", PROCS_FILE);
+
+    FILE *f = fopen(tmp, "w");
+    if (!f)
+    {
+        perror(tmp);
+        return -1;
+    }
+    for (int i = 0; i < st->count; i++)
+    {
+        if (st->arr[i].tickets > 0)
+            fprintf(f, "%d %d\n", st->arr[i].pid, st->arr[i].tickets);
+    }
+    if (fflush(f) != 0 || fsync(fileno(f)) < 0)
+    {
+        perror(tmp);
+        fclose(f);
+        unlink(tmp);
+        return -1;
+    }
+    fclose(f);
+    if (rename(tmp, PROCS_FILE) < 0)
+    {
+        perror(PROCS_FILE);
+        unlink(tmp);
+        return -1;
+    }
+
+    unsigned int gen = journal_gen(jfd);
+    if (ftruncate(jfd, 0) < 0 || write_journal_header(jfd, gen + 1) < 0)
+    {
+        perror(JOURNAL_FILE);
+        return -1;
+    }
+    return 0;
+}
+
+int focus_load_tickets(struct ticket_entry **out_arr, int *out_count)
+{
+    *out_arr = NULL;
+    *out_count = 0;
+
+    struct ticket_state st;
+    memset(&st, 0, sizeof(st));
+
+    int jfd = open_journal(0);
+    if (jfd >= 0)
+        flock(jfd, LOCK_SH);
+
+    int rc = state_load_snapshot(&st);
+    if (rc == 0 && jfd >= 0)
+    {
+        off_t pos = 0;
+        unsigned int gen = 0;
+        if (replay_journal(jfd, &st, &pos, &gen) < 0)
+            rc = -1;
+    }
+    if (jfd >= 0)
+        close(jfd); // drops the lock
+
+    if (rc < 0)
+    {
+        state_free(&st);
+        return -1;
+    }
+    state_pack(&st);
+    *out_arr = st.arr;
+    *out_count = st.count;
+    free(st.index);
+    return 0;
+}
+
+int focus_save_tickets(const struct ticket_entry *arr, int count)
+{
+    if (focus_ensure_dir(STATE_DIR) < 0)
+        return -1;
+
+    struct ticket_state st;
+    memset(&st, 0, sizeof(st));
+    for (int i = 0; i < count; i++)
+    {
+        if (arr[i].tickets > 0 && state_set(&st, arr[i].pid, arr[i].tickets) < 0)
+        {
+            state_free(&st);
+            return -1;
+        }
+    }
+
+    int jfd = open_journal(1);
+    if (jfd < 0)
+    {
+        state_free(&st);
+        return -1;
+    }
+    flock(jfd, LOCK_EX);
+    int rc = compact_locked(jfd, &st);
+    close(jfd);
+    state_free(&st);
+    return rc;
+}
+
+int focus_append_tickets(const struct ticket_entry *changes, int count)
+{
+    if (count <= 0)
+        return 0;
+    if (focus_ensure_dir(STATE_DIR) < 0)
+        return -1;
+
+    size_t size = (size_t)count * 32;
+    char *buf = (char *)malloc(size);
+    if (!buf)
+        return -1;
+    size_t len = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (changes[i].pid <= 0)
+            continue;
+        if (changes[i].tickets > 0)
+            len += (size_t)snprintf(buf + len, size - len, "s %d %d\n", changes[i].pid,
+                                    changes[i].tickets);
+        else
+            len += (size_t)snprintf(buf + len, size - len, "r %d\n", changes[i].pid);
+    }
+
+    int jfd = open_journal(1);
+    if (jfd < 0)
+    {
+        free(buf);
+        return -1;
+    }
+
+    struct stat st;
+    flock(jfd, LOCK_SH);
+    if (fstat(jfd, &st) == 0 && st.st_size == 0)
+    {
+        // new journal: the first appender writes the header
+        flock(jfd, LOCK_EX);
+        if (fstat(jfd, &st) == 0 && st.st_size == 0)
+            write_journal_header(jfd, 1);
+        flock(jfd, LOCK_SH);
+    }
+
+    int rc = 0;
+    if (write_all(jfd, buf, len) < 0)
+    {
+        perror(JOURNAL_FILE);
+        rc = -1;
+    }
+    free(buf);
+
+    // compact once the journal outgrows the threshold, unless someone else is
+    if (rc == 0 && fstat(jfd, &st) == 0 && st.st_size > JOURNAL_COMPACT_BYTES)
+    {
+        flock(jfd, LOCK_UN);
+        if (flock(jfd, LOCK_EX | LOCK_NB) == 0)
+        {
+            struct ticket_state state;
+            memset(&state, 0, sizeof(state));
+            off_t pos = 0;
+            unsigned int gen = 0;
+            if (fstat(jfd, &st) == 0 && st.st_size > JOURNAL_COMPACT_BYTES &&
+                state_load_snapshot(&state) == 0 && replay_journal(jfd, &state, &pos, &gen) >= 0)
+                compact_locked(jfd, &state);
+            state_free(&state);
+        }
+    }
+    close(jfd);
+    return rc;
+}
+
+struct focus_ticket_reader
+{
+    int jfd;
+    unsigned int gen;
+    off_t pos;
+    int loaded;
+    struct timespec snap_mtime;
+    ino_t snap_ino;
+    struct ticket_state st;
+};
+
+struct focus_ticket_reader *focus_tickets_open(void)
+{
+    struct focus_ticket_reader *r =
+        (struct focus_ticket_reader *)calloc(1, sizeof(struct focus_ticket_reader));
+    if (r)
+        r->jfd = -1;
+    return r;
+}
+
+void focus_tickets_close(struct focus_ticket_reader *r)
+{
+    if (!r)
+        return;
+    if (r->jfd >= 0)
+        close(r->jfd);
+    state_free(&r->st);
+    free(r);
+}
+
+int focus_tickets_poll(struct focus_ticket_reader *r, const struct ticket_entry **out_arr,
+                       int *out_count)
+{
+    int changed = 0;
+    int rc = 0;
+
+    if (r->jfd < 0)
+        r->jfd = open_journal(0);
+    if (r->jfd >= 0)
+        flock(r->jfd, LOCK_SH);
+
+    struct stat snap;
+    if (stat(PROCS_FILE, &snap) < 0)
+        memset(&snap, 0, sizeof(snap));
+    struct stat jst;
+    off_t jsize = (r->jfd >= 0 && fstat(r->jfd, &jst) == 0) ? jst.st_size : 0;
+    unsigned int gen = r->jfd >= 0 ? journal_gen(r->jfd) : 0;
+
+    // a new snapshot, generation or a shrunk journal means start over
+    if (!r->loaded || gen != r->gen || jsize < r->pos || snap.st_ino != r->snap_ino ||
+        snap.st_mtim.tv_sec != r->snap_mtime.tv_sec || snap.st_mtim.tv_nsec != r->snap_mtime.tv_nsec)
+    {
+        state_free(&r->st);
+        r->pos = 0;
+        r->gen = gen;
+        r->snap_ino = snap.st_ino;
+        r->snap_mtime = snap.st_mtim;
+        rc = state_load_snapshot(&r->st);
+        r->loaded = (rc == 0);
+        changed = 1;
+    }
+    if (rc == 0 && r->jfd >= 0 && jsize > r->pos)
+    {
+        int applied = replay_journal(r->jfd, &r->st, &r->pos, &r->gen);
+        if (applied < 0)
+            rc = -1;
+        else if (applied > 0)
+            changed = 1;
+    }
+
+    if (r->jfd >= 0)
+        flock(r->jfd, LOCK_UN);
+
+    if (changed)
+        state_pack(&r->st);
+    *out_arr = r->st.arr;
+    *out_count = r->st.count;
+    if (rc < 0)
+    {
+        r->loaded = 0;
+        return -1;
+    }
+    return changed;
+}
+
+/*
+ * Transactions.
+ *
+ * Placements and ticket changes are only queued until commit.  Commit
+ * keeps the last placement of every pid, groups them by target, drops
+ * pids that the target's cgroup.procs already lists and writes the
+ * rest through a single descriptor per group.  Ticket changes are
+ * appended to the journal in one write.
+ */
+
+struct txn_place
+{
+    pid_t pid;
+    int seq;
+    char group[32]; // "" = root cgroup
+};
+
+struct focus_txn
+{
+    struct txn_place *places;
+    int nplaces;
+    int cap_places;
+    struct ticket_entry *tickets;
+    int ntickets;
+    int cap_tickets;
+};
+
+struct focus_txn *focus_txn_begin(void)
+{
+    return (struct focus_txn *)calloc(1, sizeof(struct focus_txn));
+}
+
+void focus_txn_abort(struct focus_txn *txn)
+{
+    if (!txn)
+        return;
+    free(txn->places);
+    free(txn->tickets);
+    free(txn);
+}
+
+int focus_txn_place(struct focus_txn *txn, pid_t pid, const char *group)
+{
+    if (pid <= 0 || (group && strlen(group) >= sizeof(txn->places[0].group)))
+        return -1;
+
+    if (txn->nplaces >= txn->cap_places)
+    {
+        int cap = txn->cap_places ? txn->cap_places * 2 : 16;
+        struct txn_place *tmp =
+            (struct txn_place *)realloc(txn->places, sizeof(struct txn_place) * cap);
+        if (!tmp)
+            return -1;
+        txn->places = tmp;
+        txn->cap_places = cap;
+    }
+
+    struct txn_place *p = &txn->places[txn->nplaces];
+    p->pid = pid;
+    p->seq = txn->nplaces;
+    snprintf(p->group, sizeof(p->group), "%s", group ? group : "");
+    txn->nplaces++;
+    return 0;
+}
+
+int focus_txn_set_tickets(struct focus_txn *txn, pid_t pid, int tickets)
+{
+    if (pid <= 0)
+        return -1;
+
+    if (txn->ntickets >= txn->cap_tickets)
+    {
+        int cap = txn->cap_tickets ? txn->cap_tickets * 2 : 16;
+        struct ticket_entry *tmp =
+            (struct ticket_entry *)realloc(txn->tickets, sizeof(struct ticket_entry) * cap);
+        if (!tmp)
+            return -1;
+        txn->tickets = tmp;
+        txn->cap_tickets = cap;
+    }
+
+    txn->tickets[txn->ntickets].pid = pid;
+    txn->tickets[txn->ntickets].tickets = tickets > 0 ? tickets : 0;
+    txn->ntickets++;
+    return 0;
+}
+
+static int cmp_place_pid(const void *a, const void *b)
+{
+    const struct txn_place *x = (const struct txn_place *)a;
+    const struct txn_place *y = (const struct txn_place *)b;
+    if (x->pid != y->pid)
+        return x->pid < y->pid ? -1 : 1;
+    return x->seq - y->seq;
+}
+
+static int cmp_place_group(const void *a, const void *b)
+{
+    const struct txn_place *x = (const struct txn_place *)a;
+    const struct txn_place *y = (const struct txn_place *)b;
+    int c = strcmp(x->group, y->group);
+    if (c != 0)
+        return c;
+    return x->pid < y->pid ? -1 : (x->pid > y->pid);
+}
+
+static int cmp_pid(const void *a, const void *b)
+{
+    pid_t x = *(const pid_t *)a;
+    pid_t y = *(const pid_t *)b;
+    return x < y ? -1 : (x > y);
+}
+
+// Reads a cgroup.procs file into a sorted array.
+static int read_group_members(const char *path, pid_t **out, int *out_count)
+{
+    *out = NULL;
+    *out_count = 0;
+
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+
+    int capacity = 64;
+    int count = 0;
+    pid_t *arr = (pid_t *)malloc(sizeof(pid_t) * capacity);
+    int pid_i;
+    while (arr && fscanf(f, "%d", &pid_i) == 1)
+    {
+        if (count >= capacity)
+        {
+            capacity *= 2;
+            pid_t *tmp = (pid_t *)realloc(arr, sizeof(pid_t) * capacity);
+            if (!tmp)
+            {
+                free(arr);
+                arr = NULL;
+                break;
+            }
+            arr = tmp;
+        }
+        arr[count++] = (pid_t)pid_i;
+    }
+    fclose(f);
+    if (!arr)
+        return -1;
+
+    qsort(arr, count, sizeof(pid_t), cmp_pid);
+    *out = arr;
+    *out_count = count;
+    return 0;
+}
+
+int focus_group_members(const char *group, pid_t **out, int *out_count)
+{
+    char path[256];
+    group_procs_path(group, path, sizeof(path));
+    return read_group_members(path, out, out_count);
+}
+
+static int commit_group(const char *group, const struct txn_place *places, int n)
+{
+    char path[256];
+    group_procs_path(group[0] ? group : NULL, path, sizeof(path));
+
+    pid_t *members = NULL;
+    int nmembers = 0;
+    read_group_members(path, &members, &nmembers);
+
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        perror(path);
+        free(members);
+        return n;
+    }
+
+    int failed = 0;
+    for (int i = 0; i < n; i++)
+    {
+        pid_t pid = places[i].pid;
+        if (members && bsearch(&pid, members, nmembers, sizeof(pid_t), cmp_pid))
+            continue;
+
+        // cgroup.procs takes exactly one pid per write(2)
+        char buf[32];
+        int len = snprintf(buf, sizeof(buf), "%d\n", pid);
+        if (write(fd, buf, (size_t)len) != len)
+        {
+            fprintf(stderr, "Failed to move pid %d to %s: %s\n", pid,
+                    group[0] ? group : "root cgroup", strerror(errno));
+            failed++;
+        }
+    }
+
+    close(fd);
+    free(members);
+    return failed;
+}
+
+int focus_txn_commit(struct focus_txn *txn)
+{
+    int failed = 0;
+
+    if (txn->nplaces > 0)
+    {
+        // keep only the last placement queued for each pid
+        qsort(txn->places, txn->nplaces, sizeof(struct txn_place), cmp_place_pid);
+        int n = 0;
+        for (int i = 0; i < txn->nplaces; i++)
+        {
+            if (i + 1 < txn->nplaces && txn->places[i + 1].pid == txn->places[i].pid)
+                continue;
+            txn->places[n++] = txn->places[i];
+        }
+
+        qsort(txn->places, n, sizeof(struct txn_place), cmp_place_group);
+        for (int i = 0; i < n;)
+        {
+            int j = i;
+            while (j < n && strcmp(txn->places[j].group, txn->places[i].group) == 0)
+                j++;
+            failed += commit_group(txn->places[i].group, &txn->places[i], j - i);
+            i = j;
+        }
+    }
+
+    if (txn->ntickets > 0 && focus_append_tickets(txn->tickets, txn->ntickets) < 0)
+        failed++;
+
+    focus_txn_abort(txn);
+    return failed ? -1 : 0;
+}
+
+#define FOCUS_WINS_MAGIC 0x666f6377u
+
+struct focus_wins *focus_wins_map(int writable)
+{
+    int fd = open(WINS_FILE, writable ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        if (writable)
+            perror(WINS_FILE);
+        return NULL;
+    }
+
+    struct stat st;
+    if (writable && ftruncate(fd, sizeof(struct focus_wins)) < 0)
+    {
+        perror(WINS_FILE);
+        close(fd);
+        return NULL;
+    }
+    if (!writable && (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct focus_wins)))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    void *p = mmap(NULL, sizeof(struct focus_wins), writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                   MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        perror("mmap");
+        return NULL;
+    }
+
+    struct focus_wins *w = (struct focus_wins *)p;
+    if (writable)
+    {
+        memset(w, 0, sizeof(*w));
+        w->magic = FOCUS_WINS_MAGIC;
+    }
+    else if (w->magic != FOCUS_WINS_MAGIC)
+    {
+        munmap(p, sizeof(struct focus_wins));
+        return NULL;
+    }
+    return w;
+}
+
+void focus_wins_unmap(struct focus_wins *w)
+{
+    if (w)
+        munmap(w, sizeof(*w));
+}
+
+static unsigned int wins_hash(pid_t pid)
+{
+    return ((unsigned int)pid * 2654435761u) & (FOCUS_WINS_SLOTS - 1);
+}
+
+// The reset drops the tick count with the wins so shares stay consistent.
+void focus_wins_tick(struct focus_wins *w)
+{
+    if (w->used >= FOCUS_WINS_SLOTS / 4 * 3)
+    {
+        memset(w->slots, 0, sizeof(w->slots));
+        w->used = 0;
+        w->ticks = 0;
+    }
+    w->ticks++;
+}
+
+void focus_wins_add(struct focus_wins *w, pid_t pid)
+{
+    for (unsigned int h = wins_hash(pid);; h = (h + 1) & (FOCUS_WINS_SLOTS - 1))
+    {
+        struct focus_win_slot *s = &w->slots[h];
+        if (s->pid == 0)
+        {
+            s->pid = pid;
+            w->used++;
+        }
+        if (s->pid == pid)
+        {
+            s->wins++;
+            return;
+        }
+    }
+}
+
+uint64_t focus_wins_get(const struct focus_wins *w, pid_t pid)
+{
+    for (unsigned int h = wins_hash(pid), n = 0; n < FOCUS_WINS_SLOTS;
+         h = (h + 1) & (FOCUS_WINS_SLOTS - 1), n++)
+    {
+        if (w->slots[h].pid == pid)
+            return w->slots[h].wins;
+        if (w->slots[h].pid == 0)
+            return 0;
+    }
+    return 0;
+}
+
+#define FOCUS_TRACE_MAGIC 0x666f6374u
+
+/*
+ * The trace ring survives focusd restarts: a writable map keeps the
+ * records of a file with a matching header, so the ticks before a crash
+ * are still there when focusd is started again.
+ */
+struct focus_trace *focus_trace_map(int writable)
+{
+    int fd = open(TRACE_FILE, writable ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        if (writable)
+            perror(TRACE_FILE);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        perror(TRACE_FILE);
+        close(fd);
+        return NULL;
+    }
+    int fresh = (size_t)st.st_size != sizeof(struct focus_trace);
+    if (!writable && fresh)
+    {
+        close(fd);
+        return NULL;
+    }
+    if (writable && fresh && ftruncate(fd, sizeof(struct focus_trace)) < 0)
+    {
+        perror(TRACE_FILE);
+        close(fd);
+        return NULL;
+    }
+
+    void *p = mmap(NULL, sizeof(struct focus_trace), writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                   MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        perror("mmap");
+        return NULL;
+    }
+
+    struct focus_trace *t = (struct focus_trace *)p;
+    int valid =
+        t->magic == FOCUS_TRACE_MAGIC && t->record_size == sizeof(struct focus_trace_record);
+    if (writable && !valid)
+    {
+        memset(t, 0, sizeof(*t));
+        t->magic = FOCUS_TRACE_MAGIC;
+        t->record_size = sizeof(struct focus_trace_record);
+    }
+    else if (!writable && !valid)
+    {
+        munmap(p, sizeof(struct focus_trace));
+        return NULL;
+    }
+    return t;
+}
+
+void focus_trace_unmap(struct focus_trace *t)
+{
+    if (t)
+        munmap(t, sizeof(*t));
+}
+
+// Single writer; a slot reads as seq 0 while it is being rewritten.
+void focus_trace_append(struct focus_trace *t, const struct focus_trace_record *rec)
+{
+    uint64_t seq = t->next + 1;
+    struct focus_trace_record *slot = &t->records[t->next % FOCUS_TRACE_RECORDS];
+
+    __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy((char *)slot + sizeof(slot->seq), (const char *)rec + sizeof(rec->seq),
+           sizeof(*rec) - sizeof(rec->seq));
+    __atomic_store_n(&slot->seq, seq, __ATOMIC_RELEASE);
+    __atomic_store_n(&t->next, seq, __ATOMIC_RELEASE);
+}
+
+int focus_trace_read(const struct focus_trace *t, struct focus_trace_record *out, int max)
+{
+    uint64_t next = __atomic_load_n(&t->next, __ATOMIC_ACQUIRE);
+    uint64_t avail = next < FOCUS_TRACE_RECORDS ? next : FOCUS_TRACE_RECORDS;
+    if ((uint64_t)max < avail)
+        avail = (uint64_t)max;
+
+    int n = 0;
+    for (uint64_t seq = next - avail + 1; seq <= next; seq++)
+    {
+        const struct focus_trace_record *slot = &t->records[(seq - 1) % FOCUS_TRACE_RECORDS];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != seq)
+            continue;
+        out[n] = *slot;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        // overwritten while copying: the writer lapped us
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq)
+            continue;
+        n++;
+    }
+    return n;
+}
+
+void focus_raise_nofile(void)
+{
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+/*
+ * Shared /proc scanner.
+ *
+ * PIDs are listed with getdents64() on a single /proc dirfd and every
+ * per-process file is opened with openat() relative to it, read with one
+ * raw read() into a stack buffer.  Large PID ranges are split across
+ * worker threads.  Results are kept in a focus_proc_cache keyed by
+ * (pid, starttime) so a later scan can reuse cmdline/exe/uid of processes
+ * that have not changed instead of reading them again.  execve() keeps
+ * both, so an entry is only reused while comm and the inode behind
+ * /proc/<pid>/exe are also the same; otherwise a process scanned between
+ * fork and exec would keep its parent's cmdline for good.
+ */
+
+#define SCAN_MAX_THREADS 8
+#define SCAN_PIDS_PER_THREAD 2048
+
+struct linux_dirent64
+{
+    unsigned long long d_ino;
+    long long d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+struct scan_job
+{
+    int procfd;
+    int want;
+    const struct focus_proc_cache *cache;
+    const pid_t *pids;
+    struct focus_proc_info *out;
+    int begin;
+    int end;
+};
+
+void focus_proc_cache_free(struct focus_proc_cache *cache)
+{
+    free(cache->items);
+    free(cache->index);
+    cache->items = NULL;
+    cache->index = NULL;
+    cache->count = 0;
+    cache->index_cap = 0;
+}
+
+const struct focus_proc_info *focus_proc_cache_lookup(const struct focus_proc_cache *cache,
+                                                     pid_t pid)
+{
+    if (cache->index_cap == 0)
+        return NULL;
+
+    unsigned int mask = (unsigned int)cache->index_cap - 1;
+    for (unsigned int h = ((unsigned int)pid * 2654435761u) & mask;; h = (h + 1) & mask)
+    {
+        int i = cache->index[h];
+        if (i < 0)
+            return NULL;
+        if (cache->items[i].pid == pid)
+            return &cache->items[i];
+    }
+}
+
+// Takes ownership of items and rebuilds the pid index over them.
+static int proc_cache_replace(struct focus_proc_cache *cache, struct focus_proc_info *items,
+                              int count)
+{
+    int cap = 16;
+    while (cap < count * 2)
+        cap *= 2;
+
+    int *index = (int *)malloc(sizeof(int) * cap);
+    if (!index)
+    {
+        free(items);
+        return -1;
+    }
+    memset(index, 0xff, sizeof(int) * cap);
+
+    unsigned int mask = (unsigned int)cap - 1;
+    for (int i = 0; i < count; i++)
+    {
+        unsigned int h = ((unsigned int)items[i].pid * 2654435761u) & mask;
+        while (index[h] >= 0)
+            h = (h + 1) & mask;
+        index[h] = i;
+    }
+
+    focus_proc_cache_free(cache);
+    cache->items = items;
+    cache->count = count;
+    cache->index = index;
+    cache->index_cap = cap;
+    return 0;
+}
+
+// Reads a small /proc/<pid>/<name> file into buf; returns bytes read or -1.
+static int read_proc_file(int procfd, pid_t pid, const char *name, char *buf, size_t size)
+{
+    char rel[64];
+    snprintf(rel, sizeof(rel), "%d/%s", pid, name);
+
+    int fd = openat(procfd, rel, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n < 0)
+        return -1;
+    buf[n] = '\0';
+    return (int)n;
+}
+
+// Parses comm, ppid and starttime (field 22) out of /proc/<pid>/stat.
+static int parse_proc_stat(char *buf, struct focus_proc_info *pi)
+{
+    char *open = strchr(buf, '(');
+    char *close = strrchr(buf, ')');
+    if (!open || !close || close < open)
+        return -1;
+
+    size_t len = (size_t)(close - open - 1);
+    if (len >= sizeof(pi->comm))
+        len = sizeof(pi->comm) - 1;
+    memcpy(pi->comm, open + 1, len);
+    pi->comm[len] = '\0';
+
+    // close + 2 is field 3 (state); walk to field 4 (ppid) and 22 (starttime)
+    char *p = close + 2;
+    for (int field = 3; field < 22 && *p; field++)
+    {
+        p = strchr(p, ' ');
+        if (!p)
+            return -1;
+        p++;
+        if (field == 3)
+            pi->ppid = (pid_t)strtol(p, NULL, 10);
+    }
+    pi->starttime = strtoull(p, NULL, 10);
+    return 0;
+}
+
+static int scan_one(int procfd, pid_t pid, int want, const struct focus_proc_cache *cache,
+                    struct focus_proc_info *pi)
+{
+    char buf[1024];
+
+    memset(pi, 0, sizeof(*pi));
+    pi->pid = pid;
+
+    if (read_proc_file(procfd, pid, "stat", buf, sizeof(buf)) <= 0)
+        return -1;
+    if (parse_proc_stat(buf, pi) < 0)
+        return -1;
+
+    // an exec'd process has a different binary behind exe
+    char rel[32];
+    struct stat exe_st;
+    snprintf(rel, sizeof(rel), "%d/exe", pid);
+    if (want && fstatat(procfd, rel, &exe_st, 0) == 0)
+    {
+        pi->exe_dev = (unsigned long long)exe_st.st_dev;
+        pi->exe_ino = (unsigned long long)exe_st.st_ino;
+    }
+
+    const struct focus_proc_info *old = focus_proc_cache_lookup(cache, pid);
+    if (old && old->starttime == pi->starttime && strcmp(old->comm, pi->comm) == 0 &&
+        old->exe_dev == pi->exe_dev && old->exe_ino == pi->exe_ino)
+    {
+        memcpy(pi->cmdline, old->cmdline, sizeof(pi->cmdline));
+        memcpy(pi->exe, old->exe, sizeof(pi->exe));
+        pi->uid = old->uid;
+        pi->fields = old->fields;
+    }
+
+    if ((want & FOCUS_SCAN_CMDLINE) && !(pi->fields & FOCUS_SCAN_CMDLINE))
+    {
+        int n = read_proc_file(procfd, pid, "cmdline", pi->cmdline, sizeof(pi->cmdline));
+        if (n < 0)
+            n = 0;
+        while (n > 0 && pi->cmdline[n - 1] == '\0')
+            n--;
+        for (int i = 0; i < n; i++)
+        {
+            if (pi->cmdline[i] == '\0')
+                pi->cmdline[i] = ' ';
+        }
+        pi->cmdline[n] = '\0';
+        pi->fields |= FOCUS_SCAN_CMDLINE;
+    }
+
+    if ((want & FOCUS_SCAN_EXE) && !(pi->fields & FOCUS_SCAN_EXE))
+    {
+        ssize_t n = readlinkat(procfd, rel, pi->exe, sizeof(pi->exe) - 1);
+        if (n < 0)
+            n = 0; // kernel threads have no exe
+        pi->exe[n] = '\0';
+        char *deleted = strstr(pi->exe, " (deleted)");
+        if (deleted)
+            *deleted = '\0';
+        pi->fields |= FOCUS_SCAN_EXE;
+    }
+
+    if ((want & FOCUS_SCAN_UID) && !(pi->fields & FOCUS_SCAN_UID))
+    {
+        struct stat st;
+        snprintf(rel, sizeof(rel), "%d", pid);
+        if (fstatat(procfd, rel, &st, 0) < 0)
+            return -1;
+        pi->uid = st.st_uid;
+        pi->fields |= FOCUS_SCAN_UID;
+    }
+    return 0;
+}
+
+static void *scan_worker(void *arg)
+{
+    struct scan_job *job = (struct scan_job *)arg;
+    for (int i = job->begin; i < job->end; i++)
+    {
+        if (scan_one(job->procfd, job->pids[i], job->want, job->cache, &job->out[i]) < 0)
+            job->out[i].pid = 0; // exited while scanning
+    }
+    return NULL;
+}
+
+static int list_proc_pids(int procfd, pid_t **out_pids, int *out_count)
+{
+    int capacity = 1024;
+    int count = 0;
+    pid_t *pids = (pid_t *)malloc(sizeof(pid_t) * capacity);
+    if (!pids)
+        return -1;
+
+    char buf[32768];
+    for (;;)
+    {
+        long n = syscall(SYS_getdents64, procfd, buf, sizeof(buf));
+        if (n < 0)
+        {
+            perror("getdents64 /proc");
+            free(pids);
+            return -1;
+        }
+        if (n == 0)
+            break;
+
+        for (long off = 0; off < n;)
+        {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + off);
+            off += d->d_reclen;
+
+            if (d->d_type != DT_DIR || !isdigit((unsigned char)d->d_name[0]))
+                continue;
+
+            if (count >= capacity)
+            {
+                capacity *= 2;
+                pid_t *tmp = (pid_t *)realloc(pids, sizeof(pid_t) * capacity);
+                if (!tmp)
+                {
+                    free(pids);
+                    return -1;
+                }
+                pids = tmp;
+            }
+            pids[count++] = (pid_t)atoi(d->d_name);
+        }
+    }
+
+    *out_pids = pids;
+    *out_count = count;
+    return 0;
+}
+
+/*
+ * Scans every process in /proc, calling fn for each one in PID order.
+ * want selects the optional FOCUS_SCAN_* fields; comm, ppid and starttime
+ * are always filled.  The cache is refreshed with the results.
+ */
+int focus_scan_procs(struct focus_proc_cache *cache, int want, focus_proc_visit_fn fn, void *arg)
+{
+    int procfd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (procfd < 0)
+    {
+        perror("open /proc");
+        return -1;
+    }
+
+    pid_t *pids = NULL;
+    int npids = 0;
+    if (list_proc_pids(procfd, &pids, &npids) < 0)
+    {
+        close(procfd);
+        return -1;
+    }
+
+    struct focus_proc_info *results =
+        (struct focus_proc_info *)malloc(sizeof(struct focus_proc_info) * (npids > 0 ? npids : 1));
+    if (!results)
+    {
+        free(pids);
+        close(procfd);
+        return -1;
+    }
+
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int nthreads = npids / SCAN_PIDS_PER_THREAD;
+    if (nthreads > ncpu)
+        nthreads = (int)ncpu;
+    if (nthreads > SCAN_MAX_THREADS)
+        nthreads = SCAN_MAX_THREADS;
+    if (nthreads < 1)
+        nthreads = 1;
+
+    struct scan_job jobs[SCAN_MAX_THREADS];
+    pthread_t threads[SCAN_MAX_THREADS];
+    int started = 0;
+
+    for (int t = 0; t < nthreads; t++)
+    {
+        jobs[t].procfd = procfd;
+        jobs[t].want = want;
+        jobs[t].cache = cache;
+        jobs[t].pids = pids;
+        jobs[t].out = results;
+        jobs[t].begin = (int)((long)npids * t / nthreads);
+        jobs[t].end = (int)((long)npids * (t + 1) / nthreads);
+    }
+
+    // job 0 runs on the calling thread, as does any job whose thread failed
+    for (int t = 1; t < nthreads; t++)
+    {
+        if (pthread_create(&threads[t], NULL, scan_worker, &jobs[t]) != 0)
+            break;
+        started = t;
+    }
+    scan_worker(&jobs[0]);
+    for (int t = started + 1; t < nthreads; t++)
+        scan_worker(&jobs[t]);
+    for (int t = 1; t <= started; t++)
+        pthread_join(threads[t], NULL);
+
+    free(pids);
+    close(procfd);
+
+    int live = 0;
+    int rc = 0;
+    for (int i = 0; i < npids; i++)
+    {
+        if (results[i].pid <= 0)
+            continue;
+        results[live++] = results[i];
+        if (fn && rc == 0 && fn(&results[live - 1], arg) < 0)
+            rc = -1;
+    }
+
+    if (proc_cache_replace(cache, results, live) < 0)
+        return -1;
+    return rc;
+}
+
+int focus_read_proc(pid_t pid, int want, struct focus_proc_info *pi)
+{
+    static const struct focus_proc_cache empty = {NULL, 0, NULL, 0};
+    int procfd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (procfd < 0)
+        return -1;
+    int rc = scan_one(procfd, pid, want, &empty, pi);
+    close(procfd);
+    return rc;
+}
+
+/*
+ * Placement rules.
+ *
+ * RULES_FILE holds one "<field> <pattern> <group> [tickets]" rule per
+ * line, field being comm, cmdline, exe, parent (parent's comm) or uid.
+ * Patterns are substrings, double-quoted if they contain spaces; uid
+ * patterns are numeric and compared exactly.  The first matching rule
+ * in file order wins.
+ *
+ * All string patterns are compiled into one Aho-Corasick automaton whose
+ * transitions are a dense table over the byte classes that occur in the
+ * patterns, so a process is matched against every rule with one pass
+ * over each of its fields.  A pattern can only end in the field it was
+ * written for, which the output lists check.
+ */
+
+static const char *const rule_field_names[] = {"comm", "cmdline", "exe", "parent", "uid"};
+
+struct ac_output
+{
+    int rule;
+    int next; // next output of the same state, -1 = end
+};
+
+struct focus_rules
+{
+    struct focus_rule *rules;
+    int count;
+    int want;
+
+    unsigned char cls[256]; // byte -> class, 0 = byte occurs in no pattern
+    int nclasses;
+    int nstates;
+    int *delta; // nstates * nclasses
+    int *out;   // first output per state, -1 = none
+    int *dict;  // nearest state on the fail chain with outputs, -1 = none
+    struct ac_output *outputs;
+    int noutputs;
+};
+
+const char *focus_rule_field_name(int field)
+{
+    if (field < 0 || field > FOCUS_RULE_UID)
+        return "?";
+    return rule_field_names[field];
+}
+
+// Copies the next token of *s into out, honouring double quotes.
+static int next_token(const char **s, char *out, size_t size)
+{
+    const char *p = *s;
+    while (*p == ' ' || *p == '\t')
+        p++;
+    if (*p == '\0' || *p == '\n' || *p == '#')
+        return -1;
+
+    size_t n = 0;
+    if (*p == '"')
+    {
+        p++;
+        while (*p && *p != '"' && *p != '\n')
+        {
+            if (n + 1 < size)
+                out[n++] = *p;
+            p++;
+        }
+        if (*p != '"')
+            return -1;
+        p++;
+    }
+    else
+    {
+        while (*p && *p != ' ' && *p != '\t' && *p != '\n')
+        {
+            if (n + 1 < size)
+                out[n++] = *p;
+            p++;
+        }
+    }
+    out[n] = '\0';
+    *s = p;
+    return 0;
+}
+
+int focus_rule_parse(const char *line, struct focus_rule *out)
+{
+    char field[32];
+    char tickets[32];
+    const char *p = line;
+
+    memset(out, 0, sizeof(*out));
+    if (next_token(&p, field, sizeof(field)) < 0)
+        return 1; // blank or comment
+    if (next_token(&p, out->pattern, sizeof(out->pattern)) < 0 ||
+        next_token(&p, out->group, sizeof(out->group)) < 0)
+        return -1;
+
+    out->field = -1;
+    for (int i = 0; i <= FOCUS_RULE_UID; i++)
+    {
+        if (strcmp(field, rule_field_names[i]) == 0)
+            out->field = i;
+    }
+    if (out->field < 0 || out->pattern[0] == '\0')
+        return -1;
+    for (const char *c = out->pattern; *c; c++)
+    {
+        if ((unsigned char)*c < ' ')
+            return -1;
+    }
+    if (out->field == FOCUS_RULE_UID)
+    {
+        char *end;
+        strtoul(out->pattern, &end, 10);
+        if (*end != '\0')
+            return -1;
+    }
+
+    if (strcmp(out->group, "-") == 0)
+        out->group[0] = '\0';
+    else if (!profile_group_valid(out->group))
+        return -1;
+
+    if (next_token(&p, tickets, sizeof(tickets)) == 0)
+    {
+        char *end;
+        out->tickets = (int)strtol(tickets, &end, 10);
+        if (*end != '\0' || out->tickets <= 0)
+            return -1;
+    }
+    if (out->group[0] == '\0' && out->tickets == 0)
+        return -1; // a rule must do something
+    return 0;
+}
+
+int focus_rule_format(const struct focus_rule *r, char *buf, size_t size)
+{
+    int quote = strchr(r->pattern, ' ') != NULL || strchr(r->pattern, '\t') != NULL;
+    int n = snprintf(buf, size, "%s %s%s%s %s", focus_rule_field_name(r->field), quote ? "\"" : "",
+                     r->pattern, quote ? "\"" : "", r->group[0] ? r->group : "-");
+    if (r->tickets > 0 && n >= 0 && (size_t)n < size)
+        n += snprintf(buf + n, size - (size_t)n, " %d", r->tickets);
+    return n;
+}
+
+void focus_rules_free(struct focus_rules *rules)
+{
+    if (!rules)
+        return;
+    free(rules->rules);
+    free(rules->delta);
+    free(rules->out);
+    free(rules->dict);
+    free(rules->outputs);
+    free(rules);
+}
+
+int focus_rules_count(const struct focus_rules *rules)
+{
+    return rules->count;
+}
+
+const struct focus_rule *focus_rules_get(const struct focus_rules *rules, int idx)
+{
+    return (idx >= 0 && idx < rules->count) ? &rules->rules[idx] : NULL;
+}
+
+int focus_rules_want(const struct focus_rules *rules)
+{
+    return rules->want;
+}
+
+static int rules_compile(struct focus_rules *r)
+{
+    // byte classes: one per distinct pattern byte, class 0 for the rest
+    int total = 1;
+    r->nclasses = 1;
+    for (int i = 0; i < r->count; i++)
+    {
+        if (r->rules[i].field == FOCUS_RULE_UID)
+            continue;
+        for (const unsigned char *c = (const unsigned char *)r->rules[i].pattern; *c; c++)
+        {
+            if (r->cls[*c] == 0)
+                r->cls[*c] = (unsigned char)r->nclasses++;
+            total++;
+        }
+    }
+
+    int nc = r->nclasses;
+    r->delta = (int *)malloc(sizeof(int) * (size_t)total * nc);
+    r->out = (int *)malloc(sizeof(int) * total);
+    r->dict = (int *)malloc(sizeof(int) * total);
+    r->outputs = (struct ac_output *)malloc(sizeof(struct ac_output) * (r->count ? r->count : 1));
+    int *fail = (int *)malloc(sizeof(int) * total);
+    int *queue = (int *)malloc(sizeof(int) * total);
+    if (!r->delta || !r->out || !r->dict || !r->outputs || !fail || !queue)
+    {
+        free(fail);
+        free(queue);
+        return -1;
+    }
+    memset(r->delta, 0xff, sizeof(int) * (size_t)total * nc);
+
+    // trie; -1 marks a missing edge until the BFS below fills it in
+    r->nstates = 1;
+    r->out[0] = -1;
+    for (int i = 0; i < r->count; i++)
+    {
+        if (r->rules[i].field == FOCUS_RULE_UID)
+            continue;
+        int s = 0;
+        for (const unsigned char *c = (const unsigned char *)r->rules[i].pattern; *c; c++)
+        {
+            int *edge = &r->delta[s * nc + r->cls[*c]];
+            if (*edge < 0)
+            {
+                *edge = r->nstates;
+                r->out[r->nstates] = -1;
+                r->nstates++;
+            }
+            s = *edge;
+        }
+        // prepend, so walk order is reversed; matching takes the minimum
+        r->outputs[r->noutputs].rule = i;
+        r->outputs[r->noutputs].next = r->out[s];
+        r->out[s] = r->noutputs++;
+    }
+
+    // failure links breadth first, turning the trie into a full DFA
+    int head = 0, tail = 0;
+    fail[0] = 0;
+    r->dict[0] = -1;
+    for (int c = 0; c < nc; c++)
+    {
+        int t = r->delta[c];
+        if (t < 0)
+            r->delta[c] = 0;
+        else
+        {
+            fail[t] = 0;
+            r->dict[t] = -1;
+            queue[tail++] = t;
+        }
+    }
+    while (head < tail)
+    {
+        int s = queue[head++];
+        for (int c = 0; c < nc; c++)
+        {
+            int t = r->delta[s * nc + c];
+            int via = r->delta[fail[s] * nc + c];
+            if (t < 0)
+            {
+                r->delta[s * nc + c] = via;
+                continue;
+            }
+            fail[t] = via;
+            r->dict[t] = r->out[via] >= 0 ? via : r->dict[via];
+            queue[tail++] = t;
+        }
+    }
+
+    free(fail);
+    free(queue);
+    return 0;
+}
+
+struct focus_rules *focus_rules_load(void)
+{
+    struct focus_rules *r = (struct focus_rules *)calloc(1, sizeof(struct focus_rules));
+    if (!r)
+        return NULL;
+
+    FILE *f = fopen(RULES_FILE, "r");
+    if (!f && errno != ENOENT)
+    {
+        perror(RULES_FILE);
+        free(r);
+        return NULL;
+    }
+
+    int cap = 0;
+    char line[512];
+    int lineno = 0;
+    while (f && fgets(line, sizeof(line), f))
+    {
+        struct focus_rule rule;
+        lineno++;
+        int rc = focus_rule_parse(line, &rule);
+        if (rc > 0)
+            continue;
+        if (rc < 0)
+        {
+            fprintf(stderr, "%s:%d: invalid rule, skipped\n", RULES_FILE, lineno);
+            continue;
+        }
+        if (r->count >= cap)
+        {
+            cap = cap ? cap * 2 : 16;
+            struct focus_rule *tmp =
+                (struct focus_rule *)realloc(r->rules, sizeof(struct focus_rule) * cap);
+            if (!tmp)
+            {
+                fclose(f);
+                focus_rules_free(r);
+                return NULL;
+            }
+            r->rules = tmp;
+        }
+        r->rules[r->count++] = rule;
+
+        if (rule.field == FOCUS_RULE_CMDLINE)
+            r->want |= FOCUS_SCAN_CMDLINE;
+        else if (rule.field == FOCUS_RULE_EXE)
+            r->want |= FOCUS_SCAN_EXE;
+        else if (rule.field == FOCUS_RULE_UID)
+            r->want |= FOCUS_SCAN_UID;
+    }
+    if (f)
+        fclose(f);
+
+    if (rules_compile(r) < 0)
+    {
+        focus_rules_free(r);
+        return NULL;
+    }
+    return r;
+}
+
+// Runs the automaton over text; returns the lowest rule of field found.
+static int rules_scan(const struct focus_rules *r, const char *text, int field, int best)
+{
+    int s = 0;
+    for (const unsigned char *c = (const unsigned char *)text; *c; c++)
+    {
+        s = r->delta[s * r->nclasses + r->cls[*c]];
+        for (int t = r->out[s] >= 0 ? s : r->dict[s]; t >= 0; t = r->dict[t])
+        {
+            for (int o = r->out[t]; o >= 0; o = r->outputs[o].next)
+            {
+                int rule = r->outputs[o].rule;
+                if (r->rules[rule].field == field && (best < 0 || rule < best))
+                    best = rule;
+            }
+        }
+    }
+    return best;
+}
+
+int focus_rules_match(const struct focus_rules *rules, const struct focus_proc_info *pi,
+                      const char *parent_comm)
+{
+    int best = -1;
+    if (rules->count == 0)
+        return -1;
+
+    best = rules_scan(rules, pi->comm, FOCUS_RULE_COMM, best);
+    if (pi->fields & FOCUS_SCAN_CMDLINE)
+        best = rules_scan(rules, pi->cmdline, FOCUS_RULE_CMDLINE, best);
+    if (pi->fields & FOCUS_SCAN_EXE)
+        best = rules_scan(rules, pi->exe, FOCUS_RULE_EXE, best);
+    if (parent_comm)
+        best = rules_scan(rules, parent_comm, FOCUS_RULE_PARENT, best);
+
+    if (pi->fields & FOCUS_SCAN_UID)
+    {
+        for (int i = 0; i < rules->count && (best < 0 || i < best); i++)
+        {
+            if (rules->rules[i].field == FOCUS_RULE_UID &&
+                strtoul(rules->rules[i].pattern, NULL, 10) == (unsigned long)pi->uid)
+                best = i;
+        }
+    }
+    return best;
+}
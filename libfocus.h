@@ -0,0 +1,268 @@
+// libfocus.h - shared cgroup, profile and ticket-state API of focusctl/focusd
+#ifndef LIBFOCUS_H
+#define LIBFOCUS_H
+
+#include <stdint.h>
+#include <sys/types.h> // pid_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// both may be overridden at build time, e.g. -DCGROUP_ROOT=\"/mnt/cgroup2\"
+#ifndef CGROUP_ROOT
+#define CGROUP_ROOT "/sys/fs/cgroup"
+#endif
+#define FOCUS_NAME "focus"
+#define BG_NAME "background"
+
+#ifndef STATE_DIR
+#define STATE_DIR "/var/lib/focusctl"
+#endif
+#define PROCS_FILE STATE_DIR "/procs.txt"
+#define JOURNAL_FILE STATE_DIR "/procs.journal"
+#define PROFILES_FILE STATE_DIR "/profiles.conf"
+#define APPLIED_PROFILE_FILE STATE_DIR "/profiles.applied"
+#define WINS_FILE STATE_DIR "/wins.bin"
+#define RULES_FILE STATE_DIR "/rules.conf"
+#define TRACE_FILE STATE_DIR "/trace.bin"
+
+#define MAX_PROFILE_KNOBS 32
+#define FOCUS_WINS_SLOTS 16384
+#define FOCUS_TRACE_RECORDS 65536
+#define FOCUS_TRACE_WINNERS 6
+
+struct ticket_entry
+{
+    pid_t pid;
+    int tickets;
+};
+
+/*
+ * A resource profile is a list of (group, knob, value) settings written
+ * into the focus and background cgroups, see focus_profile_defaults().
+ */
+struct profile_knob
+{
+    char group[32];
+    char knob[32];
+    char value[128];
+};
+
+struct focus_profile
+{
+    struct profile_knob knobs[MAX_PROFILE_KNOBS];
+    int count;
+};
+
+/* cgroupfs helpers; errors are reported on stderr and return -1 */
+int focus_write_file(const char *path, const char *value);
+int focus_ensure_dir(const char *path);
+int focus_check_cgroup_v2(void);
+int focus_enable_controllers(void);
+// Creates the groups and applies the stored profile; profile may be NULL.
+int focus_init_cgroups(struct focus_profile *profile);
+// Moves pid into group, or into the root cgroup when group is NULL.
+int focus_move_pid(const char *group, pid_t pid);
+// Sorted pids of group's cgroup.procs (NULL = root); *out must be freed.
+int focus_group_members(const char *group, pid_t **out, int *out_count);
+
+/* resource profiles */
+void focus_profile_defaults(struct focus_profile *p);
+int focus_profile_set(struct focus_profile *p, const char *group, const char *knob,
+                      const char *value);
+int focus_load_profiles(struct focus_profile *p);
+int focus_save_profiles(const struct focus_profile *p);
+int focus_apply_profiles(const struct focus_profile *p);
+
+/*
+ * Ticket state: a PROCS_FILE snapshot plus the set/remove records appended
+ * to JOURNAL_FILE since.  *out_arr must be freed by the caller.
+ */
+int focus_load_tickets(struct ticket_entry **out_arr, int *out_count);
+// Replaces the whole state with a new snapshot and an empty journal.
+int focus_save_tickets(const struct ticket_entry *arr, int count);
+// Appends one record per change (tickets <= 0 removes) in a single write.
+int focus_append_tickets(const struct ticket_entry *changes, int count);
+
+/*
+ * Incremental reader for long-running consumers: poll() only replays the
+ * records appended since the previous call and reloads the snapshot after
+ * a compaction.  The returned array belongs to the reader and stays valid
+ * until the next poll.  Returns 1 if the state changed, 0 if not.
+ */
+struct focus_ticket_reader;
+
+struct focus_ticket_reader *focus_tickets_open(void);
+int focus_tickets_poll(struct focus_ticket_reader *r, const struct ticket_entry **out_arr,
+                       int *out_count);
+void focus_tickets_close(struct focus_ticket_reader *r);
+
+/*
+ * Transactions batch placements and ticket changes.  Commit dedupes
+ * placements per pid (the last one wins), skips pids that are already
+ * in their target group, writes each group's cgroup.procs through one
+ * open descriptor and appends all ticket changes in one journal write.
+ */
+struct focus_txn;
+
+struct focus_txn *focus_txn_begin(void);
+// Queues a move of pid into group (NULL = root cgroup).
+int focus_txn_place(struct focus_txn *txn, pid_t pid, const char *group);
+// Queues a ticket change; tickets <= 0 removes pid from the lottery.
+int focus_txn_set_tickets(struct focus_txn *txn, pid_t pid, int tickets);
+// Applies and frees txn; returns -1 if any placement or the state update failed.
+int focus_txn_commit(struct focus_txn *txn);
+void focus_txn_abort(struct focus_txn *txn);
+
+/*
+ * Win counters, exported by focusd through a shared mapping of WINS_FILE
+ * so monitors can read them without a round trip to the daemon.  The
+ * table is an open-addressing hash on pid; focusd clears it when it
+ * starts and whenever it gets three quarters full.
+ */
+struct focus_win_slot
+{
+    int32_t pid;
+    uint32_t reserved;
+    uint64_t wins;
+};
+
+struct focus_wins
+{
+    uint32_t magic;
+    uint32_t used;
+    uint64_t ticks;
+    struct focus_win_slot slots[FOCUS_WINS_SLOTS];
+};
+
+// Maps WINS_FILE; writable resets the table.  Returns NULL on failure.
+struct focus_wins *focus_wins_map(int writable);
+void focus_wins_unmap(struct focus_wins *w);
+// Counts one draw; call it once per draw, then focus_wins_add per winner.
+void focus_wins_tick(struct focus_wins *w);
+void focus_wins_add(struct focus_wins *w, pid_t pid);
+uint64_t focus_wins_get(const struct focus_wins *w, pid_t pid);
+
+/*
+ * Decision trace: focusd appends one record per tick to a ring mapped
+ * from TRACE_FILE.  Each slot is published by storing its seq (1-based
+ * position in the stream) last, so readers can tell complete records
+ * from ones that are being overwritten.
+ */
+struct focus_trace_record
+{
+    uint64_t seq;
+    uint64_t time_ns;     // CLOCK_REALTIME at the start of the tick
+    uint32_t late_us;     // wakeup later than the timeslice asked for
+    uint32_t duration_us; // from wakeup until the placements were done
+    uint32_t tickets;     // ticket total of the draw
+    uint32_t entries;     // pids in the lottery
+    uint16_t writes;      // backend placements this tick
+    uint16_t failures;
+    uint16_t nwinners; // focused pids, may exceed FOCUS_TRACE_WINNERS
+    uint16_t held;     // of them kept by --min-residency/--keep-prob
+    int32_t winners[FOCUS_TRACE_WINNERS];
+};
+
+struct focus_trace
+{
+    uint32_t magic;
+    uint32_t record_size;
+    uint64_t next; // records ever appended
+    struct focus_trace_record records[FOCUS_TRACE_RECORDS];
+};
+
+// Maps TRACE_FILE; writable keeps existing records.  NULL on failure.
+struct focus_trace *focus_trace_map(int writable);
+void focus_trace_unmap(struct focus_trace *t);
+void focus_trace_append(struct focus_trace *t, const struct focus_trace_record *rec);
+// Copies up to max of the newest complete records, oldest first.
+int focus_trace_read(const struct focus_trace *t, struct focus_trace_record *out, int max);
+
+/*
+ * /proc scanner.  comm, ppid and starttime are always filled; want selects
+ * the optional FOCUS_SCAN_* fields.  A cache passed to successive scans
+ * lets unchanged processes (same starttime, comm and exe inode) skip the
+ * optional reads; that only pays off in a long-running caller such as
+ * focusd's rule engine, one-shot commands scan once with an empty cache.
+ */
+#define FOCUS_SCAN_CMDLINE 0x1
+#define FOCUS_SCAN_UID 0x2
+#define FOCUS_SCAN_EXE 0x4
+
+struct focus_proc_info
+{
+    pid_t pid;
+    pid_t ppid;
+    uid_t uid;
+    unsigned long long starttime;
+    unsigned long long exe_dev; // binary behind /proc/<pid>/exe, 0 if unreadable
+    unsigned long long exe_ino;
+    int fields; // FOCUS_SCAN_* bits that are valid
+    char comm[64];
+    char cmdline[256];
+    char exe[256];
+};
+
+struct focus_proc_cache
+{
+    struct focus_proc_info *items;
+    int count;
+    int *index; // open addressing on pid, -1 = empty
+    int index_cap;
+};
+
+typedef int (*focus_proc_visit_fn)(const struct focus_proc_info *pi, void *arg);
+
+// Calls fn for every process in PID order, then refreshes cache.
+int focus_scan_procs(struct focus_proc_cache *cache, int want, focus_proc_visit_fn fn, void *arg);
+int focus_read_proc(pid_t pid, int want, struct focus_proc_info *pi);
+const struct focus_proc_info *focus_proc_cache_lookup(const struct focus_proc_cache *cache,
+                                                     pid_t pid);
+void focus_proc_cache_free(struct focus_proc_cache *cache);
+
+/*
+ * Placement rules from RULES_FILE, one "<field> <pattern> <group> [tickets]"
+ * per line; group "-" leaves the placement alone.  Matching is substring
+ * (exact for uid) and the first rule in file order wins.
+ */
+#define FOCUS_RULE_COMM 0
+#define FOCUS_RULE_CMDLINE 1
+#define FOCUS_RULE_EXE 2
+#define FOCUS_RULE_PARENT 3
+#define FOCUS_RULE_UID 4
+
+struct focus_rule
+{
+    int field;
+    char pattern[128];
+    char group[32]; // "" = leave placement alone
+    int tickets;    // 0 = do not register
+};
+
+struct focus_rules;
+
+// Loads and compiles RULES_FILE; a missing file gives an empty set.
+struct focus_rules *focus_rules_load(void);
+void focus_rules_free(struct focus_rules *rules);
+int focus_rules_count(const struct focus_rules *rules);
+const struct focus_rule *focus_rules_get(const struct focus_rules *rules, int idx);
+// FOCUS_SCAN_* fields the rules look at.
+int focus_rules_want(const struct focus_rules *rules);
+// Index of the first matching rule or -1; parent_comm may be NULL.
+int focus_rules_match(const struct focus_rules *rules, const struct focus_proc_info *pi,
+                      const char *parent_comm);
+// Returns 0 for a rule, 1 for a blank/comment line and -1 if invalid.
+int focus_rule_parse(const char *line, struct focus_rule *out);
+int focus_rule_format(const struct focus_rule *rule, char *buf, size_t size);
+const char *focus_rule_field_name(int field);
+
+// Raises the soft RLIMIT_NOFILE to the hard limit for per-pid descriptors.
+void focus_raise_nofile(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBFOCUS_H
@@ -1,10 +1,18 @@
 rm -rf focusd
 rm -rf focusctl
+rm -rf focusbench
+rm -rf libfocus.o libfocus.a
 
 sudo rm -rf /sys/fs/cgroup/focus
 sudo rm -rf /sys/fs/cgroup/background
+sudo rm -rf /sys/fs/cgroup/lottery
+sudo rm -rf /sys/fs/cgroup/tier-*
 
 sudo rm -rf /usr/local/bin/focusd
 sudo rm -rf /usr/local/bin/focusctl
+sudo rm -rf /usr/local/bin/focusbench
+
+sudo rm -rf /usr/local/include/libfocus.h
+sudo rm -rf /usr/local/lib/libfocus.a
 
 sudo rm -rf /var/lib/focusctl